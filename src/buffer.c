@@ -158,6 +158,7 @@ buf_clear(buf)
 buf_freeall(buf)
 	BUF		*buf;
 {
+	readfile_cancel(buf);			/* stop reading the file lazily */
 	u_blockfree(buf);				/* free the memory allocated for undo */
 	ml_close(buf, TRUE);			/* close and delete the memline/memfile */
 	buf->b_ml.ml_line_count = 0;	/* no lines in buffer */
@@ -1091,7 +1092,30 @@ do_mlines()
 	sourcing_name = (char_u *)"modelines";
 	for (lnum = 1; lnum <= curbuf->b_ml.ml_line_count && lnum <= nmlines; ++lnum)
 		chk_mline(lnum);
+	sourcing_name = NULL;
+	sourcing_lnum = 0;
 
+	/*
+	 * When the file is still being read lazily, the last lines are checked
+	 * when it has been read completely.
+	 */
+	if (!readfile_pending())
+		do_mlines_last();
+}
+
+/*
+ * do_mlines_last() - process mode lines at the end of the current file
+ */
+	void
+do_mlines_last()
+{
+	linenr_t		lnum;
+	int 			nmlines;
+
+	if (!curbuf->b_p_ml || (nmlines = (int)p_mls) == 0)
+		return;
+
+	sourcing_name = (char_u *)"modelines";
 	for (lnum = curbuf->b_ml.ml_line_count; lnum > 0 && lnum > nmlines &&
 							lnum > curbuf->b_ml.ml_line_count - nmlines; --lnum)
 		chk_mline(lnum);
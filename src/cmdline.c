@@ -1977,6 +1977,10 @@ donextfile:		if (i < 0 || i >= arg_count)
 				mf_statistics();
 				break;
 
+		case CMD_regstat:		/* print regexp cache statistics */
+				regcache_statistics();
+				break;
+
 		case CMD_read:
 				if (usefilter)
 				{
@@ -2798,6 +2802,9 @@ doecmd(fnum, fname, sfname, command, hide, newlnum)
 
 	if (!oldbuf)						/* need to read the file */
 		(void)open_buffer();
+		/* the command or line number may need the whole file */
+	if (command != NULL || newlnum > curbuf->b_ml.ml_line_count)
+		readfile_finish();
 	win_init(curwin);
 	maketitle();
 
@@ -4196,9 +4203,7 @@ ExpandFromContext(pat, num_file, file, files_only, list_notfound)
 	if (expand_context == EXPAND_OLD_SETTING)
 		return ExpandOldSetting(num_file, file);
 	ret = OK;
-	reg_ic = p_ic;
-	reg_magic = p_magic;
-	prog = regcomp(pat);
+	prog = regcomp_cached(pat, p_magic, p_ic);
 	if (prog == NULL)
 		return FAIL;
 	if (expand_context == EXPAND_COMMANDS)
@@ -23,6 +23,10 @@
 	static char_u   *old_sub = NULL;
 #endif /* VIMINFO */
 
+#define SUB_BATCH	200		/* number of changed lines put in the buffer at once */
+
+static int sub_grow __ARGS((char_u **, unsigned *, unsigned));
+
 /* dosub(lp, up, cmd)
  *
  * Perform a substitution from line 'lp' to line 'up' using the
@@ -68,6 +72,13 @@ dosub(lp, up, cmd, nextcommand, use_old)
 	int				got_match = FALSE;
 	int				temp;
 	int				which_pat;
+	char_u		   *new_start = NULL;	/* new text of the line */
+	unsigned		new_size = 0;		/* allocated size of new_start */
+	unsigned		new_len = 0;		/* length of the text in new_start */
+	unsigned		len;
+	char_u		   *sub_lines[SUB_BATCH];	/* changed lines not in buffer yet */
+	linenr_t		sub_top = 0;		/* line number of sub_lines[0] */
+	int				sub_count = 0;		/* number of lines in sub_lines[] */
 	
 	if (use_old == 2)
 		which_pat = 2;		/* use last used regexp */
@@ -213,26 +224,49 @@ dosub(lp, up, cmd, nextcommand, use_old)
 	 */
 	sub = regtilde(sub, (int)p_magic);
 
+#ifdef USE_PTHREAD
+	/*
+	 * Without confirmation and line breaks the lines of a big range can be
+	 * done by several threads.
+	 */
+	if (!do_ask && p_sth > 1 && up - lp >= SUB_BATCH && STRCHR(sub, CR) == NULL
+			&& sub_parallel(prog, sub, lp, up, do_all, &nsubs, &nlines,
+														&lnum) == OK)
+	{
+		if (nlines > 0)
+		{
+			setpcmark();
+			got_match = TRUE;
+			curwin->w_cursor.lnum = lnum;
+		}
+		lp = up + 1;				/* all lines done */
+	}
+#endif
+
 	old_line = NULL;
 	for (lnum = lp; lnum <= up && !(got_int || got_quit); ++lnum)
 	{
 		ptr = ml_get(lnum);
 		if (regexec(prog, ptr, TRUE))  /* a match on this line */
 		{
-			char_u		*new_end, *new_start = NULL;
 			char_u		*old_match, *old_copy;
 			char_u		*prev_old_match = NULL;
-			char_u		*p1;
+			char_u		*p1, *p2;
+			char_u		*line_start, *sub_start;
 			int			did_sub = FALSE;
 			int			match, lastone;
 
 			/* make a copy of the line, so it won't be taken away when updating
-				the screen */
+				the screen, and move the pointers of the match into it */
 			if ((old_line = strsave(ptr)) == NULL)
 				continue;
-			regexec(prog, old_line, TRUE);  /* match again on this line to
-											 * update the pointers. TODO:
-											 * remove extra regexec() */
+			for (i = 0; i < NSUBEXP; ++i)
+			{
+				if (prog->startp[i] != NULL)
+					prog->startp[i] = old_line + (prog->startp[i] - ptr);
+				if (prog->endp[i] != NULL)
+					prog->endp[i] = old_line + (prog->endp[i] - ptr);
+			}
 			if (!got_match)
 			{
 				setpcmark();
@@ -313,39 +347,23 @@ dosub(lp, up, cmd, nextcommand, use_old)
 
 						/* get length of substitution part */
 				sublen = regsub(prog, sub, old_line, FALSE, (int)p_magic);
-				if (new_start == NULL)
-				{
-					/*
-					 * Get some space for a temporary buffer to do the
-					 * substitution into.
-					 */
-					if ((new_start = alloc_check((unsigned)(STRLEN(old_line) +
-												sublen + 5))) == NULL)
-						goto outofmem;
-					*new_start = NUL;
-				}
-				else
-				{
-					/*
-					 * extend the temporary buffer to do the substitution into.
-					 */
-					if ((p1 = alloc_check((unsigned)(STRLEN(new_start) +
-									STRLEN(old_copy) + sublen + 1))) == NULL)
-						goto outofmem;
-					STRCPY(p1, new_start);
-					free(new_start);
-					new_start = p1;
-				}
 
-				for (new_end = new_start; *new_end; new_end++)
-					;
+				/*
+				 * Make room in the buffer for the text up to the match and the
+				 * substitution.  It is appended to, not copied for every match.
+				 */
+				if (sub_grow(&new_start, &new_size, new_len +
+						(unsigned)(prog->startp[0] - old_copy) + sublen) == FAIL)
+					goto outofmem;
+
 				/*
 				 * copy up to the part that matched
 				 */
-				while (old_copy < prog->startp[0])
-					*new_end++ = *old_copy++;
+				memmove((char *)new_start + new_len, (char *)old_copy,
+										(size_t)(prog->startp[0] - old_copy));
+				new_len += prog->startp[0] - old_copy;
 
-				regsub(prog, sub, new_end, TRUE, (int)p_magic);
+				regsub(prog, sub, new_start + new_len, TRUE, (int)p_magic);
 				nsubs++;
 				did_sub = TRUE;
 
@@ -355,28 +373,38 @@ dosub(lp, up, cmd, nextcommand, use_old)
 				 * That is the way vi works. In Vim the line break can be
 				 * avoided by preceding the CTRL-M with a CTRL-V. Now you can't
 				 * precede a line break with a CTRL-V, big deal.
+				 * The substitution is copied onto itself, without the CTRL-Vs
+				 * and the text of the lines that were broken off.
 				 */
-				while ((p1 = STRCHR(new_end, CR)) != NULL)
+				line_start = new_start;
+				sub_start = p2 = new_start + new_len;
+				for (p1 = p2; *p1 != NUL; ++p1)
 				{
-					if (p1 == new_end || p1[-1] != Ctrl('V'))
+					if (*p1 == CR && (p2 == sub_start || p2[-1] != Ctrl('V')))
 					{
 						if (u_inssub(lnum) == OK)		/* prepare for undo */
 						{
-							*p1 = NUL;					/* truncate up to the CR */
 							mark_adjust(lnum, MAXLNUM, 1L);
-							ml_append(lnum - 1, new_start, (colnr_t)(p1 - new_start + 1), FALSE);
+							ml_append(lnum - 1, line_start,
+									(colnr_t)(p2 - line_start + 1), FALSE);
 							++lnum;
 							++up;					/* number of lines increases */
-							STRCPY(new_start, p1 + 1);	/* copy the rest */
-							new_end = new_start;
+							line_start = sub_start = p2;
+							continue;
 						}
 					}
-					else							/* remove CTRL-V */
-					{
-						STRCPY(p1 - 1, p1);
-						new_end = p1;
-					}
+					else if (*p1 == CR)				/* remove CTRL-V */
+						--p2;
+					*p2++ = *p1;
 				}
+				*p2 = NUL;
+				if (line_start != new_start)		/* copy the rest */
+				{
+					memmove((char *)new_start, (char *)line_start,
+												(size_t)(p2 - line_start + 1));
+					p2 -= line_start - new_start;
+				}
+				new_len = p2 - new_start;
 
 				old_copy = prog->endp[0];	/* remember next character to be copied */
 				/*
@@ -397,14 +425,45 @@ skip:
 						 * as reference, because the substitute may have changed
 						 * the number of characters.
 						 */
-						STRCAT(new_start, old_copy);
+						len = STRLEN(old_copy);
+						if (sub_grow(&new_start, &new_size,
+											new_len + len + 1) == FAIL)
+							goto outofmem;
+						memmove((char *)new_start + new_len, (char *)old_copy,
+															(size_t)len + 1);
 						i = old_line + STRLEN(old_line) - old_match;
-						if (u_savesub(lnum) == OK)
-							ml_replace(lnum, new_start, TRUE);
-
-						free(old_line);			/* free the temp buffer */
-						old_line = new_start;
+						if (do_ask)
+						{
+							/* the line is displayed, put it in the buffer now */
+							if (u_savesub(lnum) == OK)
+								ml_replace(lnum, new_start, TRUE);
+							free(old_line);			/* free the temp buffer */
+							old_line = new_start;
+						}
+						else
+						{
+							/*
+							 * Put the line in the buffer later, together with
+							 * the lines that follow it.
+							 */
+							if (sub_count == SUB_BATCH || (sub_count > 0
+											&& sub_top + sub_count != lnum))
+							{
+								ml_replace_lines(sub_top, sub_lines, (long)sub_count);
+								sub_count = 0;
+							}
+							if (u_savesub(lnum) == OK)
+							{
+								if (sub_count == 0)
+									sub_top = lnum;
+								sub_lines[sub_count++] = new_start;
+							}
+							else
+								free(new_start);
+						}
 						new_start = NULL;
+						new_size = 0;
+						new_len = 0;
 						old_match = old_line + STRLEN(old_line) - i;
 						if (old_match < old_line)		/* safety check */
 						{
@@ -435,6 +494,9 @@ skip:
 
 outofmem:
 	free(old_line);		/* may have to free an allocated copy of the line */
+	free(new_start);
+	if (sub_count > 0)
+		ml_replace_lines(sub_top, sub_lines, (long)sub_count);
 	if (nsubs)
 	{
 		CHANGED;
@@ -460,6 +522,37 @@ outofmem:
 	free(prog);
 }
 
+/*
+ * Make sure the buffer '*bufp' of '*sizep' bytes has room for 'len' bytes.
+ * It grows to twice its size, so that appending to it many times takes
+ * linear time.  Return FAIL when out of memory.
+ */
+	static int
+sub_grow(bufp, sizep, len)
+	char_u		**bufp;
+	unsigned	*sizep;
+	unsigned	len;
+{
+	unsigned	size;
+	char_u		*p;
+
+	if (len <= *sizep)
+		return OK;
+	size = *sizep * 2;
+	if (size < len + 80)
+		size = len + 80;
+	if ((p = alloc_check(size)) == NULL)
+		return FAIL;
+	if (*bufp != NULL)
+	{
+		memmove((char *)p, (char *)*bufp, (size_t)*sizep);
+		free(*bufp);
+	}
+	*bufp = p;
+	*sizep = size;
+	return OK;
+}
+
 /*
  * doglob(cmd)
  *
@@ -540,8 +633,6 @@ doglob(type, lp, up, cmd)
 			*cmd++ = NUL;					/* replace it by a NUL */
 	}
 
-	reg_ic = p_ic;           /* set "ignore case" flag appropriately */
-
 	if ((prog = myregcomp(pat, 2, which_pat)) == NULL)
 	{
 		emsg(e_invcmd);
@@ -552,6 +643,11 @@ doglob(type, lp, up, cmd)
  * pass 1: set marks for each (not) matching line
  */
 	ndone = 0;
+#ifdef USE_PTHREAD
+	if (search_parallel(prog, lp, up, FORWARD, type, &lnum) == OK)
+		ndone = lnum;			/* done by several threads */
+	else
+#endif
 	for (lnum = lp; lnum <= up && !got_int; ++lnum)
 	{
 		match = regexec(prog, ml_get(lnum), (int)TRUE);     /* a match on this line? */
@@ -1011,8 +1011,7 @@ docomplete:
 					else if (ctrl_x_mode == CTRL_X_TAGS)
 					{
 						started_completion = TRUE;
-						reg_ic = p_ic;
-						prog = regcomp(complete_pat);
+						prog = regcomp_cached(complete_pat, p_magic, p_ic);
 						if (prog != NULL &&
 							ExpandTags(prog, &num_matches, &matches, FALSE)
 													== OK && num_matches > 0)
@@ -1570,7 +1569,7 @@ complete_dictionaries(pat, dir)
 			(void)set_highlight('r');
 			msg_highlight = TRUE;
 			MSG("Please wait, searching dictionaries");
-			prog = regcomp(pat);
+			prog = regcomp_cached(pat, p_magic, p_ic);
 		}
 		while (*dict != NUL && prog != NULL && !got_int)
 		{
@@ -30,13 +30,24 @@
 # include <proto/dos.h>		/* for Lock() and UnLock() */
 #endif
 
+#ifdef USE_MMAP
+# include <sys/mman.h>
+# ifndef MAP_FAILED
+#  define MAP_FAILED	((char *)-1)
+# endif
+#endif
+
 #define BUFSIZE		8192			/* size of normal write buffer */
 #define SBUFSIZE	256				/* size of emergency write buffer */
+#define APPEND_BATCH 128			/* number of lines appended at once */
 
 #ifdef VIMINFO
 static void check_marks_read __ARGS((void));
 #endif
 static int  write_buf __ARGS((int, char_u *, int));
+#ifdef USE_MMAP
+static char_u *readfile_nul_line __ARGS((char_u *, colnr_t));
+#endif
 
 	void
 filemess(name, s)
@@ -60,6 +71,58 @@ filemess(name, s)
 	flushbuf();
 }
 
+/*
+ * State of reading a file. It is kept between the parts that are read by
+ * readfile_part(). For a file that is read lazily it is kept in "lazy_rs"
+ * until the whole file has been read.
+ */
+typedef struct readstate
+{
+	BUF			*rs_buf;			/* buffer the lines are appended to */
+	char_u		*rs_fname;			/* file name for messages */
+	int			rs_fd;				/* file descriptor */
+	linenr_t	rs_from;			/* lines are appended after this one */
+	linenr_t	rs_lnum;			/* last appended line */
+	linenr_t	rs_linecnt;			/* line count before reading */
+	linenr_t	rs_skip_lnum;		/* number of lines to skip */
+	linenr_t	rs_nlines;			/* number of lines to append */
+	int			rs_newfile;			/* editing a new file */
+	int			rs_textmode;		/* accept CR-LF for line break */
+	int			rs_error;			/* errors encountered */
+	int			rs_split;			/* number of split lines */
+	int			rs_firstpart;		/* reading first part */
+	int			rs_lazy;			/* rest is read by readfile_more() */
+	int			rs_nointr;			/* don't stop for an interrupt */
+	int			rs_msg_save;		/* saved value of msg_scroll */
+	long		rs_filesize;		/* number of characters read */
+	long		rs_linerest;		/* remaining characters in line */
+	char_u		*rs_ptr;			/* end of characters handled */
+	char_u		*rs_line_start;		/* start of current line */
+	char_u		*rs_buffer;			/* read buffer */
+	char_u		*rs_lines[APPEND_BATCH];	/* lines not appended yet */
+	colnr_t		rs_lens[APPEND_BATCH];		/* lengths of rs_lines[] */
+	int			rs_count;			/* number of lines in rs_lines[] */
+#ifdef USE_MMAP
+	char_u		*rs_map;			/* mapped file */
+	long		rs_map_size;		/* size of mapped file */
+	long		rs_map_done;		/* bytes of map handled */
+	int			rs_has_nul;			/* NUL in current line */
+#endif
+} READSTATE;
+
+static int	readfile_part __ARGS((READSTATE *));
+static int	readfile_end __ARGS((READSTATE *));
+#ifdef USE_MMAP
+static int	readfile_unmap __ARGS((READSTATE *));
+#endif
+static char_u *readfile_scan __ARGS((char_u *, char_u *));
+static int	readfile_flush __ARGS((READSTATE *, linenr_t));
+static int	readfile_lazy_part __ARGS((void));
+static void	readfile_lazy_done __ARGS((void));
+
+static READSTATE	lazy_rs;				/* file that is read lazily */
+static int			lazy_pending = FALSE;	/* TRUE when lazy_rs is used */
+
 /*
  * Read lines from file 'fname' into the buffer after line 'from'.
  *
@@ -67,6 +130,15 @@ filemess(name, s)
  * 2. Each block is filled with characters from the file with a single read().
  * 3. The lines are inserted in the buffer with ml_append().
  *
+ * With USE_MMAP the file is mapped into memory instead, if possible. Then
+ * steps 1. and 2. are skipped, the lines are appended directly from the
+ * mapped file, which is not changed.
+ *
+ * When editing a file that is bigger than 'lazyload' Kbyte, only the
+ * first part of it is read here. The rest is read by readfile_more() while
+ * waiting for a character, or by readfile_finish() when the whole buffer is
+ * needed.
+ *
  * (caller must check that fname != NULL)
  *
  * skip_lnum is the number of lines that must be skipped
@@ -85,30 +157,19 @@ readfile(fname, sfname, from, newfile, skip_lnum, nlines)
 	linenr_t		nlines;
 {
 	int 				fd;
-	register char_u 	c;
-	register linenr_t	lnum = from;
-	register char_u 	*ptr = NULL;			/* pointer into read buffer */
-	register char_u		*buffer = NULL;			/* read buffer */
-	char_u				*new_buffer = NULL;		/* init to shut up gcc */
-	char_u				*line_start = NULL;		/* init to shut up gcc */
-	colnr_t				len;
-	register long		size;
-	register char_u		*p;
-	long				filesize = 0;
-	int					split = 0;				/* number of split lines */
-#define UNKNOWN		0x0fffffff					/* file size is unknown */
-	linenr_t			linecnt = curbuf->b_ml.ml_line_count;
-	int					incomplete = FALSE; 	/* was the last line incomplete? */
-	int 				error = FALSE;			/* errors encountered */
-	long				linerest = 0;			/* remaining characters in line */
-	int					firstpart = TRUE;		/* reading first part */
+	READSTATE			rs;
 #ifdef UNIX
 	int					perm;
 #endif
-	int					textmode = curbuf->b_p_tx;		/* accept CR-LF for line break */
 	struct stat			st;
 	int					readonly;
-	int					msg_save;
+	long				lazy_size = 0;		/* bytes to read before lazy */
+
+	/*
+	 * A file that is still being read lazily is finished first, reading may
+	 * change the current buffer.
+	 */
+	readfile_finish();
 
 	/*
 	 * If there is no file name yet, use the one for the read file.
@@ -129,8 +190,9 @@ readfile(fname, sfname, from, newfile, skip_lnum, nlines)
 	if (!did_cd)
 		fname = sfname;
 
+	rs.rs_linecnt = curbuf->b_ml.ml_line_count;
 	if (bufempty())		/* special case: buffer has no lines */
-		linecnt = 0;
+		rs.rs_linecnt = 0;
 
 #ifdef UNIX
 	/*
@@ -160,7 +222,15 @@ readfile(fname, sfname, from, newfile, skip_lnum, nlines)
 		curbuf->b_p_ro = FALSE;
 
 	if (newfile && stat((char *)fname, &st) != -1)	/* remember time of file */
+	{
 		curbuf->b_mtime = st.st_mtime;
+		/*
+		 * A big file that is edited can be read lazily.
+		 */
+		if (from == 0 && skip_lnum == 0 && nlines == MAXLNUM &&
+						!recoverymode && p_ll > 0 && st.st_size > p_ll * 1024L)
+			lazy_size = p_ll * 1024L;
+	}
 	else
 		curbuf->b_mtime = 0;
 
@@ -212,143 +282,377 @@ readfile(fname, sfname, from, newfile, skip_lnum, nlines)
 	if (newfile)
 		curbuf->b_p_eol = TRUE;
 
+	rs.rs_buf = curbuf;
+	rs.rs_fname = fname;
+	rs.rs_fd = fd;
+	rs.rs_from = from;
+	rs.rs_lnum = from;
+	rs.rs_skip_lnum = skip_lnum;
+	rs.rs_nlines = nlines;
+	rs.rs_newfile = newfile;
+	rs.rs_textmode = curbuf->b_p_tx;
+	rs.rs_error = FALSE;
+	rs.rs_split = 0;
+	rs.rs_firstpart = TRUE;
+	rs.rs_lazy = FALSE;
+	rs.rs_nointr = FALSE;
+	rs.rs_filesize = 0;
+	rs.rs_linerest = 0;
+	rs.rs_ptr = NULL;
+	rs.rs_line_start = NULL;
+	rs.rs_buffer = NULL;
+	rs.rs_count = 0;
+#ifdef USE_MMAP
+	rs.rs_map = NULL;
+	rs.rs_map_size = 0;
+	rs.rs_map_done = 0;
+	rs.rs_has_nul = FALSE;
+#endif
+
 	++no_wait_return;							/* don't wait for return yet */
 	if (!recoverymode)
 		filemess(fname, (char_u *)"");			/* show that we are busy */
 
-	msg_save = msg_scroll;
+	rs.rs_msg_save = msg_scroll;
 	msg_scroll = FALSE;							/* overwrite the file message */
-	while (!error && !got_int)
+
+#ifdef USE_MMAP
+	/*
+	 * Try mapping the file into memory. Only the lines are copied, into the
+	 * data blocks. When this fails (e.g. the file is too big for the address
+	 * space) read() is used.
+	 */
+	if (fstat(fd, &st) != -1 && st.st_size > 0)
+	{
+		rs.rs_map_size = st.st_size;
+		rs.rs_map = (char_u *)mmap(NULL, (size_t)rs.rs_map_size, PROT_READ,
+														MAP_PRIVATE, fd, (off_t)0);
+		if ((char *)rs.rs_map == MAP_FAILED || rs.rs_map_size != st.st_size)
+			rs.rs_map = NULL;
+	}
+#endif
+
+	while (!rs.rs_error && !got_int && readfile_part(&rs))
 	{
 		/*
-		 * We allocate as much space for the file as we can get, plus
-		 * space for the old line plus room for one terminating NUL.
-		 * The amount is limited by the fact that read() only can read
-		 * upto max_unsigned characters (and other things).
+		 * Stop when enough has been read to fill the screen. Keep the
+		 * file open for readfile_more().
 		 */
-#if defined(AMIGA) || defined(MSDOS)
-		if (sizeof(int) <= 2 && linerest >= 0x7ff0)
+		if (lazy_size != 0 && rs.rs_filesize >= lazy_size && rs.rs_lnum >= Rows)
 		{
-			++split;
-			*ptr = NL;				/* split line by inserting a NL */
-			size = 1;
+			if ((rs.rs_fname = strsave(fname)) != NULL
+#ifdef USE_MMAP
+					&& readfile_unmap(&rs) == OK
+#endif
+					)
+			{
+				rs.rs_lazy = TRUE;
+				/* A CTRL-C typed now is for a command, it must not leave
+				 * the buffer incomplete. */
+				rs.rs_nointr = TRUE;
+				lazy_rs = rs;
+				lazy_pending = TRUE;
+				curwin->w_cursor.lnum = 1;
+				curwin->w_cursor.col = 0;
+				--no_wait_return;
+				msg_scroll = rs.rs_msg_save;
+				return OK;
+			}
+			free(rs.rs_fname);
+			rs.rs_fname = fname;
+			lazy_size = 0;				/* out of memory, read it all now */
 		}
-		else
+	}
+
+	return readfile_end(&rs);
+}
+
+/*
+ * Read the next part of a file and append the lines in it to the buffer.
+ * Returns FALSE when there is nothing more to read.
+ */
+	static int
+readfile_part(rs)
+	READSTATE			*rs;
+{
+	register char_u 	*ptr = rs->rs_ptr;		/* pointer into read buffer */
+	register char_u		*line_start = rs->rs_line_start;
+	register long		size;
+	register char_u		*p;
+	char_u				*end;
+	char_u				*new_buffer = NULL;		/* init to shut up gcc */
+	linenr_t			lnum = rs->rs_lnum;
+	int					textmode;
+	colnr_t				len;
+
+#ifdef USE_MMAP
+	if (rs->rs_map != NULL)
+	{
+		/*
+		 * Handle the mapped file in parts of 64K, so that we can check
+		 * for an interrupt. A line may continue in the next part.
+		 */
+		if (rs->rs_map_done == rs->rs_map_size)
+			return FALSE;
+		ptr = rs->rs_map + rs->rs_map_done;
+		if (line_start == NULL)
+			line_start = ptr;
+		size = rs->rs_map_size - rs->rs_map_done;
+		if (size > 0x10000L)
+			size = 0x10000L;
+		rs->rs_map_done += size;
+		rs->rs_filesize += size;
+	}
+	else
 #endif
-		{
+	/*
+	 * We allocate as much space for the file as we can get, plus
+	 * space for the old line plus room for one terminating NUL.
+	 * The amount is limited by the fact that read() only can read
+	 * upto max_unsigned characters (and other things).
+	 */
+#if defined(AMIGA) || defined(MSDOS)
+	if (sizeof(int) <= 2 && rs->rs_linerest >= 0x7ff0)
+	{
+		++rs->rs_split;
+		*ptr = NL;				/* split line by inserting a NL */
+		size = 1;
+	}
+	else
+#endif
+	{
 #if !(defined(AMIGA) || defined(MSDOS))
-			if (sizeof(int) > 2)
-				size = 0x10000L;				/* read 64K at a time */
-			else
+		if (sizeof(int) > 2)
+			size = 0x10000L;				/* read 64K at a time */
+		else
 #endif
-			/* If you have 4 byte ints, the compiler may give a warning that
-			 * the next statement is not reached. Just ignore it. */
-				size = 0x7ff0L - linerest;		/* limit buffer to 32K */
+		/* If you have 4 byte ints, the compiler may give a warning that
+		 * the next statement is not reached. Just ignore it. */
+			size = 0x7ff0L - rs->rs_linerest;	/* limit buffer to 32K */
 
-			for ( ; size >= 10; size >>= 1)
-			{
-				if ((new_buffer = lalloc((long_u)(size + linerest + 1), FALSE)) != NULL)
-					break;
-			}
-			if (new_buffer == NULL)
-			{
-				do_outofmem_msg();
-				error = TRUE;
-				break;
-			}
-			if (linerest)		/* copy characters from the previous buffer */
-				memmove((char *)new_buffer, (char *)ptr - linerest, linerest);
-			free(buffer);
-			buffer = new_buffer;
-			ptr = buffer + linerest;
-			line_start = buffer;
-			
-			if ((size = read(fd, (char *)ptr, (size_t)size)) <= 0)
-			{
-				if (size < 0)				/* read error */
-					error = TRUE;
+		for ( ; size >= 10; size >>= 1)
+		{
+			if ((new_buffer = lalloc((long_u)(size + rs->rs_linerest + 1),
+															FALSE)) != NULL)
 				break;
-			}
-			filesize += size;				/* count the number of characters */
+		}
+		if (new_buffer == NULL)
+		{
+			do_outofmem_msg();
+			rs->rs_error = TRUE;
+			return FALSE;
+		}
+		if (rs->rs_linerest)	/* copy characters from the previous buffer */
+			memmove((char *)new_buffer, (char *)ptr - rs->rs_linerest,
+														rs->rs_linerest);
+		free(rs->rs_buffer);
+		rs->rs_buffer = new_buffer;
+		ptr = new_buffer + rs->rs_linerest;
+		line_start = new_buffer;
+		rs->rs_ptr = ptr;
+		rs->rs_line_start = line_start;
+		
+		if ((size = read(rs->rs_fd, (char *)ptr, (size_t)size)) <= 0)
+		{
+			if (size < 0)				/* read error */
+				rs->rs_error = TRUE;
+			return FALSE;
+		}
+		rs->rs_filesize += size;		/* count the number of characters */
+	}
 
-			/*
-			 * when reading the first part of a file: guess EOL type
-			 */
-			if (firstpart && p_ta)
+	/*
+	 * when reading the first part of a file: guess EOL type
+	 */
+	if (rs->rs_firstpart && p_ta)
+	{
+		for (p = ptr; p < ptr + size; ++p)
+			if (*p == NL)
 			{
-				for (p = ptr; p < ptr + size; ++p)
-					if (*p == NL)
-					{
-						if (p > ptr && p[-1] == CR)	/* found CR-NL */
-							textmode = TRUE;
-						else						/* found a single NL */
-							textmode = FALSE;
-							/* if editing a new file: may set p_tx */
-						if (newfile && curbuf->b_p_tx != textmode)
-						{
-							curbuf->b_p_tx = textmode;
-							paramchanged((char_u *)"tx");
-						}
-						break;
-					}
+				if (p > ptr && p[-1] == CR)	/* found CR-NL */
+					rs->rs_textmode = TRUE;
+				else						/* found a single NL */
+					rs->rs_textmode = FALSE;
+					/* if editing a new file: may set p_tx */
+				if (rs->rs_newfile && curbuf->b_p_tx != rs->rs_textmode)
+				{
+					curbuf->b_p_tx = rs->rs_textmode;
+					paramchanged((char_u *)"tx");
+				}
+				break;
 			}
-		}
+	}
+	textmode = rs->rs_textmode;
 
-		/*
-		 * This loop is executed once for every character read.
-		 * Keep it fast!
-		 */
-		--ptr;
-		while (++ptr, --size >= 0)
+	/*
+	 * This loop is executed once for every NL and NUL read, readfile_scan()
+	 * skips over the other characters.
+	 * The lines are collected in rs_lines[] and appended with
+	 * ml_append_lines(), which puts a NUL in the last byte of each line, we
+	 * don't need to do that here. "lnum" includes the collected lines.
+	 */
+	end = ptr + size;
+	for ( ; (ptr = readfile_scan(ptr, end)) < end; ++ptr)
+	{
+		if (*ptr == NUL)
 		{
-			if ((c = *ptr) != NUL && c != NL)	/* catch most common case */
-				continue;
-			if (c == NUL)
-				*ptr = NL;		/* NULs are replaced by newlines! */
+#ifdef USE_MMAP
+			if (rs->rs_map != NULL)
+				rs->rs_has_nul = TRUE;	/* replaced when appending the line */
 			else
+#endif
+				*ptr = NL;			/* NULs are replaced by newlines! */
+		}
+		else
+		{
+			if (rs->rs_skip_lnum == 0)
 			{
-				if (skip_lnum == 0)
+				len = ptr - line_start + 1;
+				if (textmode && ptr > line_start && ptr[-1] == CR)
+					--len;						/* remove CR */
+#ifdef USE_MMAP
+				if (rs->rs_has_nul)
 				{
-					*ptr = NUL;		/* end of line */
-					len = ptr - line_start + 1;
-					if (textmode && ptr[-1] == CR)	/* remove CR */
-					{
-						ptr[-1] = NUL;
-						--len;
-					}
-					if (ml_append(lnum, line_start, len, newfile) == FAIL)
+					/* the copy of a line with a NUL is appended by itself */
+					if (readfile_flush(rs, lnum) == FAIL
+							|| (p = readfile_nul_line(line_start, len)) == NULL)
+						rs->rs_error = TRUE;
+					else
 					{
-						error = TRUE;
-						break;
-					}
-					++lnum;
-					if (--nlines == 0)
-					{
-						error = TRUE;		/* break loop */
-						line_start = ptr;	/* nothing left to write */
-						break;
+						if (ml_append(lnum, p, len, rs->rs_newfile) == FAIL)
+							rs->rs_error = TRUE;
+						free(p);
 					}
+					rs->rs_has_nul = FALSE;
 				}
 				else
-					--skip_lnum;
-				line_start = ptr + 1;
+#endif
+				{
+					rs->rs_lines[rs->rs_count] = line_start;
+					rs->rs_lens[rs->rs_count] = len;
+					if (++rs->rs_count == APPEND_BATCH &&
+										readfile_flush(rs, lnum + 1) == FAIL)
+						rs->rs_error = TRUE;
+				}
+				if (rs->rs_error)
+					break;
+				++lnum;
+				if (--rs->rs_nlines == 0)
+				{
+					rs->rs_error = TRUE;	/* break loop */
+					line_start = ptr;		/* nothing left to write */
+					break;
+				}
 			}
+			else
+				--rs->rs_skip_lnum;
+#ifdef USE_MMAP
+			rs->rs_has_nul = FALSE;
+#endif
+			line_start = ptr + 1;
 		}
-		linerest = ptr - line_start;
-		firstpart = FALSE;
+	}
+		/* the read buffer is freed for the next part, append the lines now */
+	if (readfile_flush(rs, lnum) == FAIL)
+		rs->rs_error = TRUE;
+	rs->rs_linerest = ptr - line_start;
+	rs->rs_ptr = ptr;
+	rs->rs_line_start = line_start;
+	rs->rs_lnum = lnum;
+	rs->rs_firstpart = FALSE;
+	if (!rs->rs_nointr)
 		breakcheck();
+	return TRUE;
+}
+
+/*
+ * Return a pointer to the first NL or NUL from "p" up to "end", or "end" when
+ * there is none. This is where readfile() spends most of its time, therefore
+ * the characters are checked a long_u at a time: A byte in "w" is zero when
+ * the same byte in "(w - ones) & ~w & highs" has its high bit set.
+ */
+	static char_u *
+readfile_scan(p, end)
+	register char_u		*p;
+	char_u				*end;
+{
+	register long_u		w;
+	register long_u		ones = (~(long_u)0) / 0xff;	/* 0x0101..01 */
+	register long_u		highs = ones << 7;			/* 0x8080..80 */
+	long_u				nls = ones * NL;			/* NL in every byte */
+
+		/* check the characters until "p" is aligned */
+	while (p < end && (long_u)p % sizeof(long_u) != 0)
+	{
+		if (*p == NUL || *p == NL)
+			return p;
+		++p;
+	}
+
+	for ( ; end - p >= (long)sizeof(long_u); p += sizeof(long_u))
+	{
+		w = *(long_u *)p;
+		if (((w - ones) & ~w & highs) != 0)					/* a NUL */
+			break;
+		w ^= nls;
+		if (((w - ones) & ~w & highs) != 0)					/* a NL */
+			break;
 	}
 
-	if (error && nlines == 0)	/* not an error, max. number of lines reached */
+		/* find the NUL or NL in the long_u, or check the last characters */
+	while (p < end && *p != NUL && *p != NL)
+		++p;
+	return p;
+}
+
+/*
+ * Append the lines collected in rs_lines[] to the buffer. "lnum" is the line
+ * number the last of them will get.
+ * return FAIL for failure, OK otherwise
+ */
+	static int
+readfile_flush(rs, lnum)
+	READSTATE	*rs;
+	linenr_t	lnum;
+{
+	int			count = rs->rs_count;
+
+	if (count == 0)
+		return OK;
+	rs->rs_count = 0;
+	return ml_append_lines(lnum - count, rs->rs_lines, rs->rs_lens,
+												(long)count, rs->rs_newfile);
+}
+
+/*
+ * Finish reading a file: append an incomplete last line, close the file and
+ * give the message about the file that was read.
+ * Must be called with curbuf set to the buffer that was read into.
+ *
+ * return FAIL for failure, OK otherwise
+ */
+	static int
+readfile_end(rs)
+	READSTATE			*rs;
+{
+	char_u				*fname = rs->rs_fname;
+	char_u				*p;
+	colnr_t				len;
+	linenr_t			linecnt;
+	int					incomplete = FALSE; 	/* was the last line incomplete? */
+	int					error = rs->rs_error;
+	int					interrupted = (got_int && !rs->rs_nointr);
+
+	if (error && rs->rs_nlines == 0)	/* not an error, max. number of lines reached */
 		error = FALSE;
 
-	if (!error && !got_int && linerest != 0
+	if (!error && !interrupted && rs->rs_linerest != 0
 #ifdef MSDOS
 	/*
 	 * in MSDOS textmode ignore a trailing CTRL-Z
 	 */
-		&& !(!curbuf->b_p_bin && *line_start == Ctrl('Z') &&
-											ptr == line_start + 1)
+		&& !(!curbuf->b_p_bin && *rs->rs_line_start == Ctrl('Z') &&
+									rs->rs_ptr == rs->rs_line_start + 1)
 #endif
 									)
 	{
@@ -357,25 +661,39 @@ readfile(fname, sfname, from, newfile, skip_lnum, nlines)
 		 * complete the line ourselves.
 		 */
 		incomplete = TRUE;
-		if (newfile && curbuf->b_p_bin)		/* remember for when writing */
+		if (rs->rs_newfile && curbuf->b_p_bin)	/* remember for when writing */
 			curbuf->b_p_eol = FALSE;
-		*ptr = NUL;
-		if (ml_append(lnum, line_start,
-						(colnr_t)(ptr - line_start + 1), newfile) == FAIL)
+		len = rs->rs_ptr - rs->rs_line_start + 1;
+#ifdef USE_MMAP
+		/* can't put a NUL after the end of the mapped file, copy the line */
+		if (rs->rs_map != NULL)
+			p = readfile_nul_line(rs->rs_line_start, len);
+		else
+#endif
+			p = rs->rs_line_start;
+		if (p == NULL || ml_append(rs->rs_lnum, p, len, rs->rs_newfile) == FAIL)
 			error = TRUE;
 		else
-			++lnum;
+			++rs->rs_lnum;
+#ifdef USE_MMAP
+		if (rs->rs_map != NULL)
+			free(p);
+#endif
 	}
-	if (lnum != from && !newfile)	/* added at least one line */
+	if (rs->rs_lnum != rs->rs_from && !rs->rs_newfile)	/* added at least one line */
 		CHANGED;
 
-	close(fd);						/* errors are ignored */
-	free(buffer);
+#ifdef USE_MMAP
+	if (rs->rs_map != NULL)
+		munmap((char *)rs->rs_map, (size_t)rs->rs_map_size);
+#endif
+	close(rs->rs_fd);				/* errors are ignored */
+	free(rs->rs_buffer);
 
 	--no_wait_return;				/* may wait for return now */
 	if (recoverymode)				/* in recovery mode return here */
 	{
-		msg_scroll = msg_save;
+		msg_scroll = rs->rs_msg_save;
 		if (error)
 			return FAIL;
 #ifdef VIMINFO
@@ -385,18 +703,18 @@ readfile(fname, sfname, from, newfile, skip_lnum, nlines)
 	}
 
 		/* need to delete the last line, which comes from the empty buffer */
-	if (newfile && !(curbuf->b_ml.ml_flags & ML_EMPTY))
+	if (rs->rs_newfile && !(curbuf->b_ml.ml_flags & ML_EMPTY))
 		ml_delete(curbuf->b_ml.ml_line_count, FALSE);
-	linecnt = curbuf->b_ml.ml_line_count - linecnt;
-	if (filesize == 0)
+	linecnt = curbuf->b_ml.ml_line_count - rs->rs_linecnt;
+	if (rs->rs_filesize == 0)
 		linecnt = 0;
-	if (!newfile)
-		mark_adjust(from + 1, MAXLNUM, (long)linecnt);
+	if (!rs->rs_newfile)
+		mark_adjust(rs->rs_from + 1, MAXLNUM, (long)linecnt);
 
-	if (got_int)
+	if (interrupted)
 	{
 		filemess(fname, e_interr);
-		msg_scroll = msg_save;
+		msg_scroll = rs->rs_msg_save;
 #ifdef VIMINFO
 		check_marks_read();
 #endif /* VIMINFO */
@@ -410,19 +728,19 @@ readfile(fname, sfname, from, newfile, skip_lnum, nlines)
 					"\" %s%s%s%s%s%ld line%s, %ld character%s",
 			curbuf->b_p_ro ? (p_shm ? "[RO] " : "[readonly] ") : "",
 			incomplete ? (p_shm ? "[last]" : "[Incomplete last line] ") : "",
-			split ? "[long lines split] " : "",
+			rs->rs_split ? "[long lines split] " : "",
 			error ? "[READ ERRORS] " : "",
 #ifdef MSDOS
-			textmode ? "" : "[notextmode] ",
+			rs->rs_textmode ? "" : "[notextmode] ",
 #else
-			textmode ? "[textmode] " : "",
+			rs->rs_textmode ? "[textmode] " : "",
 #endif
 			(long)linecnt, plural((long)linecnt),
-			filesize, plural(filesize));
+			rs->rs_filesize, plural(rs->rs_filesize));
 	msg_trunc(IObuff);
-	msg_scroll = msg_save;
+	msg_scroll = rs->rs_msg_save;
 
-	if (error && newfile)	/* with errors we should not write the file */
+	if (error && rs->rs_newfile)	/* with errors we should not write the file */
 	{
 		curbuf->b_p_ro = TRUE;
 		paramchanged((char_u *)"ro");
@@ -430,9 +748,10 @@ readfile(fname, sfname, from, newfile, skip_lnum, nlines)
 
 	u_clearline();		/* cannot use "U" command after adding lines */
 
-	if (from < curbuf->b_ml.ml_line_count)
+		/* put cursor at first new line (already done when reading lazily) */
+	if (!rs->rs_lazy && rs->rs_from < curbuf->b_ml.ml_line_count)
 	{
-		curwin->w_cursor.lnum = from + 1;	/* put cursor at first new line */
+		curwin->w_cursor.lnum = rs->rs_from + 1;
 		curwin->w_cursor.col = 0;
 	}
 
@@ -442,6 +761,170 @@ readfile(fname, sfname, from, newfile, skip_lnum, nlines)
 	return OK;
 }
 
+/*
+ * Return TRUE when a file is still being read lazily.
+ */
+	int
+readfile_pending()
+{
+	return lazy_pending;
+}
+
+/*
+ * Read the next part of a file that is being read lazily. Called while
+ * waiting for the user to type a character. The ruler is updated after each
+ * part. When the end of the file has been reached the file message is given.
+ */
+	void
+readfile_more()
+{
+	if (!lazy_pending)
+		return;
+	if (readfile_lazy_part())
+	{
+		if (State == NORMAL || State == NORMAL_BUSY)
+		{
+			showruler(TRUE);
+			setcursor();
+			flushbuf();
+		}
+		return;
+	}
+	readfile_lazy_done();
+	if (State == NORMAL || State == NORMAL_BUSY)	/* not at hit-return */
+	{
+		if (must_redraw)		/* a modeline may have changed something */
+			updateScreen(must_redraw);
+		showruler(TRUE);
+		setcursor();
+	}
+	flushbuf();
+}
+
+/*
+ * Read the rest of a file that is being read lazily. Must be called before
+ * doing something that needs all the lines of the buffer.
+ */
+	void
+readfile_finish()
+{
+	if (!lazy_pending)
+		return;
+	while (readfile_lazy_part())
+		;
+	readfile_lazy_done();
+}
+
+/*
+ * Stop reading buffer "buf" lazily, it is being freed.
+ */
+	void
+readfile_cancel(buf)
+	BUF		*buf;
+{
+	if (!lazy_pending || lazy_rs.rs_buf != buf)
+		return;
+	lazy_pending = FALSE;
+	close(lazy_rs.rs_fd);
+	free(lazy_rs.rs_buffer);
+	free(lazy_rs.rs_fname);
+}
+
+/*
+ * Read one part of the file that is being read lazily.
+ * Returns FALSE when there is nothing more to read.
+ */
+	static int
+readfile_lazy_part()
+{
+	BUF			*save_curbuf = curbuf;
+	int			retval;
+
+	curbuf = lazy_rs.rs_buf;
+	retval = (!lazy_rs.rs_error && readfile_part(&lazy_rs));
+	curbuf = save_curbuf;
+	return retval;
+}
+
+/*
+ * The file that was read lazily has been read completely: close it, give
+ * the message and check the modelines at the end of the file.
+ */
+	static void
+readfile_lazy_done()
+{
+	BUF		*save_curbuf = curbuf;
+
+	lazy_pending = FALSE;
+	curbuf = lazy_rs.rs_buf;
+	++no_wait_return;
+	lazy_rs.rs_msg_save = msg_scroll;
+	msg_scroll = FALSE;
+	(void)readfile_end(&lazy_rs);
+	free(lazy_rs.rs_fname);
+	curbuf = save_curbuf;
+		/* window options in a modeline would go to the wrong window */
+	if (curbuf == lazy_rs.rs_buf)
+		do_mlines_last();
+}
+
+#ifdef USE_MMAP
+/*
+ * Continue reading a mapped file with read(). Used for a file that is read
+ * lazily: It may be truncated before it has been read completely, accessing
+ * the mapped memory beyond the end of the file would cause a crash.
+ * The start of a line that was not appended yet is copied.
+ * Returns FAIL when out of memory.
+ */
+	static int
+readfile_unmap(rs)
+	READSTATE	*rs;
+{
+	char_u		*p;
+
+	if (rs->rs_map == NULL)
+		return OK;
+	if (lseek(rs->rs_fd, (off_t)rs->rs_map_done, SEEK_SET) != rs->rs_map_done ||
+			(rs->rs_buffer = lalloc((long_u)(rs->rs_linerest + 1), TRUE)) == NULL)
+		return FAIL;
+	memmove((char *)rs->rs_buffer, (char *)rs->rs_line_start,
+													(size_t)rs->rs_linerest);
+	for (p = rs->rs_buffer; p < rs->rs_buffer + rs->rs_linerest; ++p)
+		if (*p == NUL)
+			*p = NL;			/* NULs are replaced by newlines! */
+	munmap((char *)rs->rs_map, (size_t)rs->rs_map_size);
+	rs->rs_map = NULL;
+	rs->rs_has_nul = FALSE;
+	rs->rs_line_start = rs->rs_buffer;
+	rs->rs_ptr = rs->rs_buffer + rs->rs_linerest;
+	return OK;
+}
+
+/*
+ * Make a copy of a line in a mapped file, which can't be changed.
+ * 'len' includes the line end, a NUL is put there. NUL characters in the
+ * line are replaced by newlines, like readfile() does for a file that is read.
+ * Returns NULL when out of memory.
+ */
+	static char_u *
+readfile_nul_line(line, len)
+	char_u		*line;
+	colnr_t		len;
+{
+	char_u		*copy;
+	char_u		*p;
+
+	if ((copy = alloc_check((unsigned)len)) == NULL)
+		return NULL;
+	memmove((char *)copy, (char *)line, (size_t)(len - 1));
+	copy[len - 1] = NUL;
+	for (p = copy; p < copy + len - 1; ++p)
+		if (*p == NUL)
+			*p = NL;
+	return copy;
+}
+#endif
+
 #ifdef VIMINFO
 	static void
 check_marks_read()
@@ -848,6 +848,7 @@ vgetc()
 
 	real_State = State;
 	c = vgetorpeek(TRUE);
+	readfile_finish();			/* the command may need the whole file */
 /*
  * get extra byte for special keys
  */
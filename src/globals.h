@@ -222,7 +222,6 @@ EXTERN int		term_console INIT(= FALSE);	/* set to TRUE when Amiga window used */
 EXTERN int		termcap_active INIT(= FALSE);	/* set to TRUE by starttermcap() */
 EXTERN int		bangredo INIT(= FALSE);		/* set to TRUE whith ! command */
 EXTERN int		searchcmdlen;				/* length of previous search command */
-EXTERN int 		reg_ic INIT(= 0); 			/* p_ic passed to to regexec() */
 
 EXTERN int		did_outofmem_msg INIT(= FALSE);
 											/* set after out of memory msg */
@@ -522,6 +522,10 @@ main(argc, argv)
 
 	setpcmark();
 
+		/* commands below may need the whole file */
+	if (doqf || win_count > 1 || command || tagname)
+		readfile_finish();
+
 	if (doqf && qf_init() == FAIL)		/* if reading error file fails: exit */
 		mch_windexit(3);
 
@@ -43,6 +43,13 @@
 #include "proto.h"
 #include "param.h"
 #include <fcntl.h>
+#ifdef UNIX
+# include <sys/uio.h>		/* for writev() */
+#endif
+#ifdef USE_PTHREAD
+# include <pthread.h>
+# include <signal.h>
+#endif
 
 /* 
  * Some systems have the page size in statfs, some in stat
@@ -74,12 +81,74 @@ extern int dos2;						/* this is in amiga.c */
 
 #define MEMFILE_PAGE_SIZE 4096			/* default page size */
 
+#define MF_MAX_RUN		16		/* max. number of blocks written at once */
+#define MF_READAHEAD	16		/* number of pages read at once */
+#define MF_PROT_PART	4		/* protect up to (x - 1) / x of used pages */
+
+/*
+ * Number of system calls and pages for all swap files, for ":mfstat".
+ */
+static long mf_nr_seek = 0;			/* lseek() calls */
+static long mf_nr_read = 0;			/* read() calls */
+static long mf_nr_read_pages = 0;	/* pages read */
+static long mf_nr_ra_pages = 0;		/* pages found in read-ahead buffer */
+static long mf_nr_write = 0;		/* write(), writev() and pwrite() calls */
+static long mf_nr_write_pages = 0;	/* pages written */
+static long mf_nr_fsync = 0;		/* fsync() calls */
+
+#ifdef USE_PTHREAD
+/*
+ * With USE_PTHREAD, mf_sync() does not write the blocks itself when it is
+ * called while waiting for a character. It copies the dirty blocks into a
+ * job for a writer thread. The thread writes them and calls fsync(), so
+ * typing is not delayed when the swap file is on a slow file system.
+ * Before the swap file is read, written or closed in another way, the jobs
+ * for it must be finished: mf_wait().
+ */
+typedef struct mf_wpage	MF_WPAGE;
+typedef struct mf_wjob	MF_WJOB;
+
+struct mf_wpage
+{
+	MF_WPAGE	*wp_next;
+	long_u		wp_offset;		/* offset in the file */
+	unsigned	wp_size;		/* number of bytes to write */
+	char_u		*wp_data;		/* copy of the data, follows this struct */
+};
+
+struct mf_wjob
+{
+	MF_WJOB		*wj_next;
+	MEMFILE		*wj_mfp;		/* memfile the job is for */
+	int			wj_fd;			/* dup() of mf_fd, closed when done */
+	MF_WPAGE	*wj_first;		/* pages to write, in this order */
+	MF_WPAGE	*wj_last;
+};
+
+static MF_WJOB	*mf_job = NULL;			/* job being filled by mf_sync() */
+static MF_WJOB	*mf_job_first = NULL;	/* jobs for the writer thread */
+static MF_WJOB	*mf_job_last = NULL;
+static int		mf_writer_started = FALSE;
+
+static pthread_mutex_t	mf_job_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	mf_job_added = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t	mf_job_done = PTHREAD_COND_INITIALIZER;
+
+/*
+ * The writer thread counts its system calls separately, only with
+ * mf_job_mutex locked. The counters above are only used by the main thread.
+ */
+static long mf_nr_thread_write = 0;			/* pwrite() calls */
+static long mf_nr_thread_write_pages = 0;	/* pages written */
+static long mf_nr_thread_fsync = 0;			/* fsync() calls */
+#endif
+
 static long total_mem_used = 0;			/* total memory used for memfiles */
 
 static void mf_ins_hash __ARGS((MEMFILE *, BHDR *));
 static void mf_rem_hash __ARGS((MEMFILE *, BHDR *));
 static BHDR *mf_find_hash __ARGS((MEMFILE *, blocknr_t));
-static void mf_ins_used __ARGS((MEMFILE *, BHDR *));
+static void mf_ins_used __ARGS((MEMFILE *, BHDR *, int));
 static void mf_rem_used __ARGS((MEMFILE *, BHDR *));
 static BHDR *mf_release __ARGS((MEMFILE *, int));
 static BHDR *mf_alloc_bhdr __ARGS((MEMFILE *, int));
@@ -88,8 +157,25 @@ static void mf_ins_free __ARGS((MEMFILE *, BHDR *));
 static BHDR *mf_rem_free __ARGS((MEMFILE *));
 static int	mf_read __ARGS((MEMFILE *, BHDR *));
 static int	mf_write __ARGS((MEMFILE *, BHDR *));
+static int	mf_write_page __ARGS((MEMFILE *, long_u, char_u *, unsigned));
+static int	mf_write_run __ARGS((MEMFILE *, BHDR **, int));
+static void mf_ra_invalid __ARGS((MEMFILE *, long_u, unsigned));
+static BHDR **mf_sync_list __ARGS((MEMFILE *, int, int *));
+static int	mf_cmp_bnum __ARGS((const void *, const void *));
+#ifdef USE_PTHREAD
+static void mf_wait __ARGS((MEMFILE *));
+static int	mf_job_start __ARGS((MEMFILE *));
+static void mf_job_submit __ARGS((void));
+static void *mf_writer __ARGS((void *));
+#endif
 static int	mf_trans_add __ARGS((MEMFILE *, BHDR *));
 static void mf_do_open __ARGS((MEMFILE *, char_u *, int));
+static void mf_hash_init __ARGS((MF_HASHTAB *));
+static void mf_hash_free __ARGS((MF_HASHTAB *));
+static MF_HASHITEM *mf_hash_find __ARGS((MF_HASHTAB *, blocknr_t));
+static void mf_hash_add_item __ARGS((MF_HASHTAB *, MF_HASHITEM *));
+static void mf_hash_rem_item __ARGS((MF_HASHTAB *, MF_HASHITEM *));
+static void mf_hash_grow __ARGS((MF_HASHTAB *));
 
 /*
  * The functions for using a memfile:
@@ -125,7 +211,6 @@ mf_open(fname, new, fail_nofile)
 	int		fail_nofile;
 {
 	MEMFILE			*mfp;
-	int				i;
 	long			size;
 #ifdef UNIX
 	struct STATFS 	stf;
@@ -155,13 +240,22 @@ mf_open(fname, new, fail_nofile)
 	mfp->mf_free_first = NULL;			/* free list is empty */
 	mfp->mf_used_first = NULL;			/* used list is empty */
 	mfp->mf_used_last = NULL;
+	mfp->mf_used_probe = NULL;
 	mfp->mf_dirty = FALSE;
 	mfp->mf_used_count = 0;
-	for (i = 0; i < MEMHASHSIZE; ++i)
-	{
-		mfp->mf_hash[i] = NULL;			/* hash lists are empty */
-		mfp->mf_trans[i] = NULL;		/* trans lists are empty */
-	}
+	mfp->mf_prot_count = 0;
+	mfp->mf_nr_hit = 0;
+	mfp->mf_nr_miss = 0;
+	mfp->mf_nr_release = 0;
+	mfp->mf_ra_buf = NULL;
+	mfp->mf_ra_count = 0;
+	mfp->mf_ra_next = 0;
+#ifdef USE_PTHREAD
+	mfp->mf_pending = 0;
+	mfp->mf_write_error = FALSE;
+#endif
+	mf_hash_init(&mfp->mf_hash);		/* hash lists are empty */
+	mf_hash_init(&mfp->mf_trans);		/* trans lists are empty */
 	mfp->mf_page_size = MEMFILE_PAGE_SIZE;
 
 #ifdef UNIX
@@ -225,13 +319,16 @@ mf_close(mfp, delete)
 	int		delete;
 {
 	BHDR		*hp, *nextp;
-	NR_TRANS	*tp, *tpnext;
-	int			i;
+	NR_TRANS	*tp;
+	long_u		i;
 
 	if (mfp == NULL)				/* safety check */
 		return;
 	if (mfp->mf_fd >= 0)
 	{
+#ifdef USE_PTHREAD
+		mf_wait(mfp);
+#endif
 		if (close(mfp->mf_fd) < 0)
 			EMSG("Close error on swap file");
 	}
@@ -245,12 +342,15 @@ mf_close(mfp, delete)
 	}
 	while (mfp->mf_free_first != NULL)		/* free entries in free list */
 		(void)free(mf_rem_free(mfp));
-	for (i = 0; i < MEMHASHSIZE; ++i)		/* free entries in trans lists */
-		for (tp = mfp->mf_trans[i]; tp != NULL; tp = tpnext)
+	for (i = 0; i <= mfp->mf_trans.mht_mask; ++i)	/* free entries in trans lists */
+		while ((tp = (NR_TRANS *)mfp->mf_trans.mht_buckets[i]) != NULL)
 		{
-			tpnext = tp->nt_next;
+			mf_hash_rem_item(&mfp->mf_trans, (MF_HASHITEM *)tp);
 			free(tp);
 		}
+	mf_hash_free(&mfp->mf_hash);
+	mf_hash_free(&mfp->mf_trans);
+	free(mfp->mf_ra_buf);
 	free(mfp->mf_fname);
 	free(mfp->mf_xfname);
 	free(mfp);
@@ -336,7 +436,7 @@ mf_new(mfp, negative, page_count)
 	hp->bh_flags = BH_LOCKED | BH_DIRTY;		/* new block is always dirty */
 	mfp->mf_dirty = TRUE;
 	hp->bh_page_count = page_count;
-	mf_ins_used(mfp, hp);
+	mf_ins_used(mfp, hp, FALSE);
 	mf_ins_hash(mfp, hp);
 
 	return hp;
@@ -386,15 +486,18 @@ mf_get(mfp, nr, page_count)
 			mf_free_bhdr(hp);
 			return NULL;
 		}
+		++mfp->mf_nr_miss;
+		hp->bh_flags |= BH_LOCKED;
+		mf_ins_used(mfp, hp, FALSE);	/* put in front of probation part */
 	}
 	else
 	{
+		++mfp->mf_nr_hit;
 		mf_rem_used(mfp, hp);	/* remove from list, insert in front below */
 		mf_rem_hash(mfp, hp);
+		hp->bh_flags |= BH_LOCKED;
+		mf_ins_used(mfp, hp, TRUE);		/* put in front of used list */
 	}
-
-	hp->bh_flags |= BH_LOCKED;
-	mf_ins_used(mfp, hp);		/* put in front of used list */
 	mf_ins_hash(mfp, hp);		/* put in front of hash list */
 
 	return hp;
@@ -455,7 +558,8 @@ mf_free(mfp, hp)
  *	if 'all' is FALSE blocks with negative numbers are not synced, even when
  *  they are dirty!
  *  if 'check_char' is TRUE, stop syncing when a character becomes available,
- *  but sync at least one block.
+ *  but sync at least one block. With USE_PTHREAD the writer thread is used
+ *  then, when 'all' is FALSE.
  *
  * Return FAIL for failure, OK otherwise
  */
@@ -467,9 +571,17 @@ mf_sync(mfp, all, check_char)
 {
 	int		status;
 	BHDR	*hp;
+	BHDR	**list;
+	int		count;
+	int		done;
+	int		i, n;
 #if defined(MSDOS) || defined(SCO) || defined(__COHERENT__)
 	int		fd;
 #endif
+#ifdef USE_PTHREAD
+	int		async = FALSE;
+	int		busy;
+#endif
 
 	if (mfp->mf_fd < 0)		/* there is no file, nothing to do */
 	{
@@ -477,19 +589,73 @@ mf_sync(mfp, all, check_char)
 		return FAIL;
 	}
 
+#ifdef USE_PTHREAD
+	/*
+	 * If the writer thread is still busy with the previous sync, try again
+	 * later, don't pile up copies of the blocks.
+	 */
+	if (check_char && !all)
+	{
+		pthread_mutex_lock(&mf_job_mutex);
+		busy = (mfp->mf_pending > 0);
+		pthread_mutex_unlock(&mf_job_mutex);
+		if (busy)
+			return OK;
+		async = TRUE;
+	}
+	mf_wait(mfp);
+	if (async && mf_job_start(mfp) == FAIL)
+		async = FALSE;
+#endif
+
 	/*
-	 * sync from last to first (may reduce the probability of an inconsistent file)
+	 * The dirty blocks are sorted on block number, so that a run of
+	 * consecutive blocks can be written with one system call. If there is
+	 * no memory for the list, sync from last to first (may reduce the
+	 * probability of an inconsistent file).
 	 * If a write fails, it is very likely caused by a full filesystem. Then we
 	 * only try to write blocks within the existing file. If that also fails then
 	 * we give up.
 	 */
 	status = OK;
-	for (hp = mfp->mf_used_last; hp != NULL; hp = hp->bh_prev)
-		if ((all || hp->bh_bnum >= 0) && (hp->bh_flags & BH_DIRTY) &&
-					(status == OK || (hp->bh_bnum >= 0 &&
-						hp->bh_bnum < mfp->mf_infile_count)))
+	if ((list = mf_sync_list(mfp, all, &count)) == NULL)
+	{
+		for (hp = mfp->mf_used_last; hp != NULL; hp = hp->bh_prev)
+			if ((all || hp->bh_bnum >= 0) && (hp->bh_flags & BH_DIRTY) &&
+						(status == OK || (hp->bh_bnum >= 0 &&
+							hp->bh_bnum < mfp->mf_infile_count)))
+			{
+				if (mf_write(mfp, hp) == FAIL)
+				{
+					if (status == FAIL)		/* double error: quit syncing */
+						break;
+					status = FAIL;
+				}
+				if (check_char && mch_char_avail())	/* char available now */
+					break;
+			}
+		done = (hp == NULL);
+	}
+	else
+	{
+		for (i = 0; i < count; i += n)
 		{
-			if (mf_write(mfp, hp) == FAIL)
+			hp = list[i];
+			n = 1;
+			if (status == FAIL)
+			{
+				if (hp->bh_bnum < 0 || hp->bh_bnum >= mfp->mf_infile_count)
+					continue;
+			}
+			else if (hp->bh_bnum >= 0 && hp->bh_bnum <= mfp->mf_infile_count)
+			{
+				/* a block in the file or just after it: find a run */
+				while (i + n < count && n < MF_MAX_RUN && list[i + n]->bh_bnum
+						== list[i + n - 1]->bh_bnum + list[i + n - 1]->bh_page_count)
+					++n;
+			}
+			if ((n == 1 ? mf_write(mfp, hp)
+						: mf_write_run(mfp, list + i, n)) == FAIL)
 			{
 				if (status == FAIL)		/* double error: quit syncing */
 					break;
@@ -498,14 +664,25 @@ mf_sync(mfp, all, check_char)
 			if (check_char && mch_char_avail())	/* char available now */
 				break;
 		}
+		done = (i >= count);
+		free(list);
+	}
 	
 	/*
 	 * If the whole list is flushed, the memfile is not dirty anymore.
 	 * In case of an error this flag is also set, to avoid trying all the time.
 	 */
-	if (hp == NULL || status == FAIL)
+	if (done || status == FAIL)
 		mfp->mf_dirty = FALSE;
 
+#ifdef USE_PTHREAD
+	if (async)
+	{
+		mf_job_submit();		/* writer thread does the fsync() */
+		return status;
+	}
+#endif
+
 #if defined(UNIX) && !defined(SCO) && !defined(__COHERENT__)
 	/* SGI has fsync() -- webb */
 # if !defined(SVR4) && !defined(__sgi) && (defined(MIPS) || defined(MIPSEB) || defined(m88k))
@@ -514,6 +691,7 @@ mf_sync(mfp, all, check_char)
 	/*
 	 * Unix has the very useful fsync() function, just what we need.
 	 */
+	++mf_nr_fsync;
 	if (fsync(mfp->mf_fd))
 		status = FAIL;
 # endif
@@ -551,6 +729,61 @@ mf_sync(mfp, all, check_char)
 	return status;
 }
 
+/*
+ * Make a list of the dirty blocks for mf_sync(), sorted on block number.
+ * When 'all' is TRUE blocks with a negative number are included, they get a
+ * positive number first. The number of blocks is put in *countp.
+ *
+ * Return NULL when out of memory.
+ */
+	static BHDR **
+mf_sync_list(mfp, all, countp)
+	MEMFILE		*mfp;
+	int			all;
+	int			*countp;
+{
+	BHDR		**list;
+	BHDR		*hp;
+	int			count = 0;
+
+	for (hp = mfp->mf_used_first; hp != NULL; hp = hp->bh_next)
+		if ((all || hp->bh_bnum >= 0) && (hp->bh_flags & BH_DIRTY))
+			++count;
+	if ((list = (BHDR **)lalloc((long_u)((count + 1) * sizeof(BHDR *)),
+															FALSE)) == NULL)
+		return NULL;
+
+	/*
+	 * Number the negative blocks from last to first, like they would get
+	 * numbers when written one by one. When mf_trans_add() fails mf_write()
+	 * tries again.
+	 */
+	count = 0;
+	for (hp = mfp->mf_used_last; hp != NULL; hp = hp->bh_prev)
+		if ((all || hp->bh_bnum >= 0) && (hp->bh_flags & BH_DIRTY))
+		{
+			if (hp->bh_bnum < 0)
+				(void)mf_trans_add(mfp, hp);
+			list[count++] = hp;
+		}
+	qsort((void *)list, (size_t)count, sizeof(BHDR *), mf_cmp_bnum);
+	*countp = count;
+	return list;
+}
+
+/*
+ * compare function for qsort() in mf_sync_list()
+ */
+	static int
+mf_cmp_bnum(a, b)
+	const void	*a, *b;
+{
+	blocknr_t	na = (*(BHDR **)a)->bh_bnum;
+	blocknr_t	nb = (*(BHDR **)b)->bh_bnum;
+
+	return (na < nb ? -1 : na > nb ? 1 : 0);
+}
+
 /*
  * insert block *hp in front of hashlist of memfile *mfp
  */
@@ -559,16 +792,7 @@ mf_ins_hash(mfp, hp)
 	MEMFILE	*mfp;
 	BHDR	*hp;
 {
-	BHDR	*hhp;
-	int		hash;
-
-	hash = MEMHASH(hp->bh_bnum);
-	hhp = mfp->mf_hash[hash];
-	hp->bh_hash_next = hhp;
-	hp->bh_hash_prev = NULL;
-	if (hhp != NULL)
-		hhp->bh_hash_prev = hp;
-	mfp->mf_hash[hash] = hp;
+	mf_hash_add_item(&mfp->mf_hash, (MF_HASHITEM *)hp);
 }
 
 /*
@@ -579,13 +803,7 @@ mf_rem_hash(mfp, hp)
 	MEMFILE	*mfp;
 	BHDR	*hp;
 {
-	if (hp->bh_hash_prev == NULL)
-		mfp->mf_hash[MEMHASH(hp->bh_bnum)] = hp->bh_hash_next;
-	else
-		hp->bh_hash_prev->bh_hash_next = hp->bh_hash_next;
-	
-	if (hp->bh_hash_next)
-		hp->bh_hash_next->bh_hash_prev = hp->bh_hash_prev;
+	mf_hash_rem_item(&mfp->mf_hash, (MF_HASHITEM *)hp);
 }
 
 /*
@@ -596,31 +814,80 @@ mf_find_hash(mfp, nr)
 	MEMFILE		*mfp;
 	blocknr_t	nr;
 {
-	BHDR		*hp;
-
-	for (hp = mfp->mf_hash[MEMHASH(nr)]; hp != NULL; hp = hp->bh_hash_next)
-		if (hp->bh_bnum == nr)
-			break;
-	return hp;
+	return (BHDR *)mf_hash_find(&mfp->mf_hash, nr);
 }
 
 /*
- * insert block *hp in front of used list of memfile *mfp
+ * The used list is split in two parts (segmented LRU). In front are the
+ * protected blocks, which have been used more than once. After them, starting
+ * at mf_used_probe, are the probation blocks, which have been used once since
+ * they were read or created. mf_release() takes blocks from the end, thus a
+ * search through the whole file only replaces probation blocks and the often
+ * used pointer blocks and blocks displayed in a window stay in memory.
+ * When the protected part gets too big its last block is moved to the
+ * probation part, it is released when not used again soon.
+ */
+
+/*
+ * insert block *hp in the used list of memfile *mfp
+ * If 'protect' is TRUE in front of the list, otherwise in front of the
+ * probation part.
  */
 	static void
-mf_ins_used(mfp, hp)
+mf_ins_used(mfp, hp, protect)
 	MEMFILE	*mfp;
 	BHDR	*hp;
+	int		protect;
 {
-	hp->bh_next = mfp->mf_used_first;
-	mfp->mf_used_first = hp;
-	hp->bh_prev = NULL;
-	if (hp->bh_next == NULL)		/* list was empty, adjust last pointer */
+	BHDR	*next;
+	BHDR	*lastp;
+
+	if (protect)
+	{
+		next = mfp->mf_used_first;
+		hp->bh_flags |= BH_PROTECT;
+		mfp->mf_prot_count += hp->bh_page_count;
+	}
+	else
+	{
+		next = mfp->mf_used_probe;
+		hp->bh_flags &= ~BH_PROTECT;
+		mfp->mf_used_probe = hp;
+	}
+	hp->bh_next = next;
+	if (next == NULL)				/* insert at end, adjust last pointer */
+	{
+		hp->bh_prev = mfp->mf_used_last;
 		mfp->mf_used_last = hp;
+	}
 	else
-		hp->bh_next->bh_prev = hp;
+	{
+		hp->bh_prev = next->bh_prev;
+		next->bh_prev = hp;
+	}
+	if (hp->bh_prev == NULL)		/* insert at start */
+		mfp->mf_used_first = hp;
+	else
+		hp->bh_prev->bh_next = hp;
 	mfp->mf_used_count += hp->bh_page_count;
 	total_mem_used += hp->bh_page_count * mfp->mf_page_size;
+
+	/*
+	 * Move the last protected blocks to the probation part, until the
+	 * protected part is not more than (MF_PROT_PART - 1) / MF_PROT_PART of
+	 * the used pages.
+	 */
+	while (mfp->mf_prot_count * MF_PROT_PART >
+							mfp->mf_used_count * (MF_PROT_PART - 1))
+	{
+		if (mfp->mf_used_probe == NULL)
+			lastp = mfp->mf_used_last;
+		else
+			lastp = mfp->mf_used_probe->bh_prev;
+		lastp->bh_flags &= ~BH_PROTECT;
+		mfp->mf_prot_count -= lastp->bh_page_count;
+		mfp->mf_used_probe = lastp;
+	}
 }
 
 /*
@@ -639,13 +906,21 @@ mf_rem_used(mfp, hp)
 		mfp->mf_used_first = hp->bh_next;
 	else
 		hp->bh_prev->bh_next = hp->bh_next;
+	if (hp == mfp->mf_used_probe)	/* first block in probation part */
+		mfp->mf_used_probe = hp->bh_next;
+	if (hp->bh_flags & BH_PROTECT)
+	{
+		hp->bh_flags &= ~BH_PROTECT;
+		mfp->mf_prot_count -= hp->bh_page_count;
+	}
 	mfp->mf_used_count -= hp->bh_page_count;
 	total_mem_used -= hp->bh_page_count * mfp->mf_page_size;
 }
 
 /*
  * Release the least recently used block from the used list if the number
- * of used memory blocks gets to big.
+ * of used memory blocks gets to big. This is a probation block, unless all
+ * of them are locked.
  *
  * Return the block header to the caller, including the memory block, so
  * it can be re-used. Make sure the page_count is right.
@@ -677,6 +952,9 @@ mf_release(mfp, page_count)
 	if (hp == NULL)		/* not a single one that can be released */
 		return NULL;
 
+#ifdef USE_PTHREAD
+	mf_wait(mfp);		/* block may not have been written yet */
+#endif
 		/*
 		 * If the block is dirty, write it.
 		 * If the write fails we don't free it.
@@ -686,6 +964,7 @@ mf_release(mfp, page_count)
 
 	mf_rem_used(mfp, hp);
 	mf_rem_hash(mfp, hp);
+	++mfp->mf_nr_release;
 
 /*
  * If a BHDR is returned, make sure that the page_count of bh_data is right
@@ -721,6 +1000,10 @@ mf_release_all()
 	{
 		mfp = buf->b_ml.ml_mfp;
 		if (mfp != NULL && mfp->mf_fd >= 0)		/* only if there is a memfile with a file */
+		{
+#ifdef USE_PTHREAD
+			mf_wait(mfp);
+#endif
 			for (hp = mfp->mf_used_last; hp != NULL; )
 			{
 				if (!(hp->bh_flags & BH_LOCKED) &&
@@ -735,6 +1018,7 @@ mf_release_all()
 				else
 					hp = hp->bh_prev;
 			}
+		}
 	}
 	return retval;
 }
@@ -812,23 +1096,74 @@ mf_read(mfp, hp)
 	long_u		offset;
 	unsigned	page_size;
 	unsigned	size;
+	blocknr_t	nr;
+	int			sequential;
+	char_u		*buf;
+	unsigned	buf_size;
+	long		len;
 
 	if (mfp->mf_fd < 0)		/* there is no file, can't read */
 		return FAIL;
+#ifdef USE_PTHREAD
+	mf_wait(mfp);			/* block may not have been written yet */
+#endif
 
 	page_size = mfp->mf_page_size;
-	offset = page_size * hp->bh_bnum;
+	nr = hp->bh_bnum;
+	offset = page_size * nr;
 	size = page_size * hp->bh_page_count;
+
+	/*
+	 * When blocks are read in sequence, e.g. when ml_find_line() goes through
+	 * the file, MF_READAHEAD pages are read at once into mf_ra_buf. The next
+	 * blocks are then copied from there.
+	 */
+	if (mfp->mf_ra_count > 0 && nr >= mfp->mf_ra_first &&
+				nr + hp->bh_page_count <= mfp->mf_ra_first + mfp->mf_ra_count)
+	{
+		memmove((char *)hp->bh_data, (char *)mfp->mf_ra_buf +
+						page_size * (nr - mfp->mf_ra_first), (size_t)size);
+		mfp->mf_ra_next = nr + hp->bh_page_count;
+		mf_nr_ra_pages += hp->bh_page_count;
+		return OK;
+	}
+	sequential = (nr == mfp->mf_ra_next);
+	mfp->mf_ra_next = nr + hp->bh_page_count;
+
+	buf = hp->bh_data;
+	buf_size = size;
+	if (sequential && mfp->mf_infile_count - nr > hp->bh_page_count &&
+			hp->bh_page_count < MF_READAHEAD && (mfp->mf_ra_buf != NULL ||
+				(mfp->mf_ra_buf = lalloc((long_u)page_size * MF_READAHEAD,
+														FALSE)) != NULL))
+	{
+		buf = mfp->mf_ra_buf;
+		if (mfp->mf_infile_count - nr < MF_READAHEAD)
+			buf_size = page_size * (mfp->mf_infile_count - nr);
+		else
+			buf_size = page_size * MF_READAHEAD;
+		mfp->mf_ra_count = 0;
+	}
+
+	++mf_nr_seek;
 	if (lseek(mfp->mf_fd, offset, SEEK_SET) != offset)
 	{
 		EMSG("Seek error in swap file read");
 		return FAIL;
 	}
-	if (read(mfp->mf_fd, hp->bh_data, (size_t)size) != size)
+	++mf_nr_read;
+	if ((len = read(mfp->mf_fd, buf, (size_t)buf_size)) < (long)size)
 	{
 		EMSG("Read error in swap file");
 		return FAIL;
 	}
+	mf_nr_read_pages += len / page_size;
+	if (buf != hp->bh_data)
+	{
+		mfp->mf_ra_first = nr;
+		mfp->mf_ra_count = len / page_size;
+		memmove((char *)hp->bh_data, (char *)buf, (size_t)size);
+	}
 	return OK;
 }
 
@@ -876,18 +1211,13 @@ mf_write(mfp, hp)
 			hp2 = hp;
 
 		offset = page_size * nr;
-		if (lseek(mfp->mf_fd, offset, SEEK_SET) != offset)
-		{
-			EMSG("Seek error in swap file write");
-			return FAIL;
-		}
 		if (hp2 == NULL)			/* freed block, fill with dummy data */
 			page_count = 1;
 		else
 			page_count = hp2->bh_page_count;
 		size = page_size * page_count;
-		if (write(mfp->mf_fd, (hp2 == NULL ? hp : hp2)->bh_data,
-													(size_t)size) != size)
+		if (mf_write_page(mfp, offset, (hp2 == NULL ? hp : hp2)->bh_data,
+															size) == FAIL)
 		{
 			/*
 			 * Avoid repeating the error message, this mostly happens when the
@@ -912,6 +1242,340 @@ mf_write(mfp, hp)
 	return OK;
 }
 
+/*
+ * write 'size' bytes from 'data' to the file at 'offset'
+ * When mf_sync() is filling a job for the writer thread, the data is copied
+ * into the job instead.
+ *
+ * Return FAIL for failure, OK otherwise
+ */
+	static int
+mf_write_page(mfp, offset, data, size)
+	MEMFILE		*mfp;
+	long_u		offset;
+	char_u		*data;
+	unsigned	size;
+{
+#ifdef USE_PTHREAD
+	MF_WPAGE	*wp;
+
+	if (mf_job != NULL && (wp = (MF_WPAGE *)lalloc(
+						(long_u)(sizeof(MF_WPAGE) + size), FALSE)) != NULL)
+	{
+		wp->wp_next = NULL;
+		wp->wp_offset = offset;
+		wp->wp_size = size;
+		wp->wp_data = (char_u *)(wp + 1);
+		memmove((char *)wp->wp_data, (char *)data, (size_t)size);
+		if (mf_job->wj_last == NULL)
+			mf_job->wj_first = wp;
+		else
+			mf_job->wj_last->wp_next = wp;
+		mf_job->wj_last = wp;
+		mf_ra_invalid(mfp, offset, size);
+		return OK;
+	}
+	mf_wait(mfp);		/* out of memory: write it now */
+#endif
+	mf_ra_invalid(mfp, offset, size);
+	++mf_nr_seek;
+	if (lseek(mfp->mf_fd, offset, SEEK_SET) != offset)
+	{
+		EMSG("Seek error in swap file write");
+		return FAIL;
+	}
+	++mf_nr_write;
+	mf_nr_write_pages += size / mfp->mf_page_size;
+	if (write(mfp->mf_fd, data, (size_t)size) != size)
+		return FAIL;
+	return OK;
+}
+
+/*
+ * Write a run of 'count' dirty blocks with consecutive numbers, starting with
+ * *hpp. The first one must be in the file or just after it.
+ * On Unix writev() writes them with one system call. When filling a job for
+ * the writer thread, the blocks are copied into one page of the job.
+ *
+ * Return FAIL for failure, OK otherwise
+ */
+	static int
+mf_write_run(mfp, hpp, count)
+	MEMFILE		*mfp;
+	BHDR		**hpp;
+	int			count;
+{
+	long_u		offset;
+	unsigned	size;
+	unsigned	page_size;
+	int			i;
+	int			retval = OK;
+#ifdef UNIX
+	struct iovec	iov[MF_MAX_RUN];
+#endif
+#ifdef USE_PTHREAD
+	MF_WPAGE	*wp = NULL;
+	char_u		*p;
+#endif
+
+	if (mfp->mf_fd < 0)		/* there is no file, can't write */
+		return FAIL;
+
+	page_size = mfp->mf_page_size;
+	offset = page_size * hpp[0]->bh_bnum;
+	size = 0;
+	for (i = 0; i < count; ++i)
+		size += page_size * hpp[i]->bh_page_count;
+	mf_ra_invalid(mfp, offset, size);
+
+#ifdef USE_PTHREAD
+	if (mf_job != NULL && (wp = (MF_WPAGE *)lalloc(
+						(long_u)(sizeof(MF_WPAGE) + size), FALSE)) != NULL)
+	{
+		wp->wp_next = NULL;
+		wp->wp_offset = offset;
+		wp->wp_size = size;
+		wp->wp_data = (char_u *)(wp + 1);
+		p = wp->wp_data;
+		for (i = 0; i < count; ++i)
+		{
+			memmove((char *)p, (char *)hpp[i]->bh_data,
+							(size_t)(page_size * hpp[i]->bh_page_count));
+			p += page_size * hpp[i]->bh_page_count;
+		}
+		if (mf_job->wj_last == NULL)
+			mf_job->wj_first = wp;
+		else
+			mf_job->wj_last->wp_next = wp;
+		mf_job->wj_last = wp;
+	}
+	else
+	{
+		mf_wait(mfp);
+#endif
+		++mf_nr_seek;
+		if (lseek(mfp->mf_fd, offset, SEEK_SET) != offset)
+		{
+			EMSG("Seek error in swap file write");
+			return FAIL;
+		}
+#ifdef UNIX
+		for (i = 0; i < count; ++i)
+		{
+			iov[i].iov_base = (char *)hpp[i]->bh_data;
+			iov[i].iov_len = page_size * hpp[i]->bh_page_count;
+		}
+		++mf_nr_write;
+		if (writev(mfp->mf_fd, iov, count) != size)
+			retval = FAIL;
+#else
+		for (i = 0; i < count && retval == OK; ++i)
+		{
+			++mf_nr_write;
+			if (write(mfp->mf_fd, hpp[i]->bh_data, (size_t)(page_size *
+									hpp[i]->bh_page_count)) != page_size *
+									hpp[i]->bh_page_count)
+				retval = FAIL;
+		}
+#endif
+		mf_nr_write_pages += size / page_size;
+#ifdef USE_PTHREAD
+	}
+#endif
+	if (retval == FAIL)
+	{
+		/* see mf_write() for the message */
+		if (!did_swapwrite_msg)
+			EMSG("Write error in swap file");
+		did_swapwrite_msg = TRUE;
+		return FAIL;
+	}
+	did_swapwrite_msg = FALSE;
+	for (i = 0; i < count; ++i)
+		hpp[i]->bh_flags &= ~BH_DIRTY;
+	if (hpp[0]->bh_bnum + size / page_size > mfp->mf_infile_count)
+		mfp->mf_infile_count = hpp[0]->bh_bnum + size / page_size;
+	return OK;
+}
+
+/*
+ * Data is written to the file at 'offset', 'size' bytes: Forget the pages in
+ * the read-ahead buffer when they overlap.
+ */
+	static void
+mf_ra_invalid(mfp, offset, size)
+	MEMFILE		*mfp;
+	long_u		offset;
+	unsigned	size;
+{
+	long_u		ra_offset;
+
+	ra_offset = (long_u)mfp->mf_page_size * mfp->mf_ra_first;
+	if (mfp->mf_ra_count > 0 && offset < ra_offset
+						+ (long_u)mfp->mf_page_size * mfp->mf_ra_count
+					&& offset + size > ra_offset)
+		mfp->mf_ra_count = 0;
+}
+
+#ifdef USE_PTHREAD
+/*
+ * Wait until the writer thread has finished the jobs for memfile 'mfp'.
+ * If writing failed, give a message and make all blocks in memory dirty, so
+ * that they are written again.
+ */
+	static void
+mf_wait(mfp)
+	MEMFILE		*mfp;
+{
+	BHDR		*hp;
+	int			error;
+
+	pthread_mutex_lock(&mf_job_mutex);
+	while (mfp->mf_pending > 0)
+		pthread_cond_wait(&mf_job_done, &mf_job_mutex);
+	error = mfp->mf_write_error;
+	mfp->mf_write_error = FALSE;
+	pthread_mutex_unlock(&mf_job_mutex);
+
+	if (error)
+	{
+		if (!did_swapwrite_msg)
+			EMSG("Write error in swap file");
+		did_swapwrite_msg = TRUE;
+		for (hp = mfp->mf_used_first; hp != NULL; hp = hp->bh_next)
+			if (hp->bh_bnum >= 0)
+				hp->bh_flags |= BH_DIRTY;
+		mfp->mf_dirty = TRUE;
+	}
+}
+
+/*
+ * Start filling a job for the writer thread, in mf_job. Start the thread
+ * when this is the first time.
+ *
+ * Return FAIL when the blocks must be written without the thread.
+ */
+	static int
+mf_job_start(mfp)
+	MEMFILE		*mfp;
+{
+	pthread_t	thread;
+	sigset_t	set, oldset;
+	int			fd;
+
+	if (!mf_writer_started)
+	{
+		/*
+		 * Signals must be handled by the main thread, the writer thread
+		 * blocks them all.
+		 */
+		sigfillset(&set);
+		pthread_sigmask(SIG_BLOCK, &set, &oldset);
+		if (pthread_create(&thread, NULL, mf_writer, NULL) == 0)
+		{
+			pthread_detach(thread);
+			mf_writer_started = TRUE;
+		}
+		pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+		if (!mf_writer_started)
+			return FAIL;
+	}
+
+	/*
+	 * The thread uses its own file descriptor, ml_setname() may close mf_fd.
+	 */
+	if ((fd = dup(mfp->mf_fd)) < 0)
+		return FAIL;
+	if ((mf_job = (MF_WJOB *)lalloc((long_u)sizeof(MF_WJOB), FALSE)) == NULL)
+	{
+		close(fd);
+		return FAIL;
+	}
+	mf_job->wj_next = NULL;
+	mf_job->wj_mfp = mfp;
+	mf_job->wj_fd = fd;
+	mf_job->wj_first = NULL;
+	mf_job->wj_last = NULL;
+	return OK;
+}
+
+/*
+ * Hand the job in mf_job to the writer thread.
+ */
+	static void
+mf_job_submit()
+{
+	pthread_mutex_lock(&mf_job_mutex);
+	if (mf_job_last == NULL)
+		mf_job_first = mf_job;
+	else
+		mf_job_last->wj_next = mf_job;
+	mf_job_last = mf_job;
+	++mf_job->wj_mfp->mf_pending;
+	pthread_cond_signal(&mf_job_added);
+	pthread_mutex_unlock(&mf_job_mutex);
+	mf_job = NULL;
+}
+
+/*
+ * The writer thread: write the pages of each job in turn and fsync() the
+ * file. Errors are remembered in the memfile, mf_wait() reports them.
+ */
+	static void *
+mf_writer(arg)
+	void		*arg;
+{
+	MF_WJOB		*job;
+	MF_WPAGE	*wp;
+	int			error;
+	long		nr_write, nr_write_pages;
+
+	for (;;)
+	{
+		pthread_mutex_lock(&mf_job_mutex);
+		while (mf_job_first == NULL)
+			pthread_cond_wait(&mf_job_added, &mf_job_mutex);
+		job = mf_job_first;
+		if ((mf_job_first = job->wj_next) == NULL)
+			mf_job_last = NULL;
+		pthread_mutex_unlock(&mf_job_mutex);
+
+		error = FALSE;
+		nr_write = 0;
+		nr_write_pages = 0;
+		while ((wp = job->wj_first) != NULL)
+		{
+			if (!error)
+			{
+				++nr_write;
+				nr_write_pages += wp->wp_size / job->wj_mfp->mf_page_size;
+				if (pwrite(job->wj_fd, (char *)wp->wp_data, (size_t)wp->wp_size,
+									(off_t)wp->wp_offset) != wp->wp_size)
+					error = TRUE;
+			}
+			job->wj_first = wp->wp_next;
+			free(wp);
+		}
+		if (!error && fsync(job->wj_fd))
+			error = TRUE;
+		close(job->wj_fd);
+
+		pthread_mutex_lock(&mf_job_mutex);
+		mf_nr_thread_write += nr_write;
+		mf_nr_thread_write_pages += nr_write_pages;
+		++mf_nr_thread_fsync;
+		if (error)
+			job->wj_mfp->mf_write_error = TRUE;
+		--job->wj_mfp->mf_pending;
+		pthread_cond_broadcast(&mf_job_done);
+		pthread_mutex_unlock(&mf_job_mutex);
+		free(job);
+	}
+	/*NOTREACHED*/
+	return NULL;
+}
+#endif
+
 /*
  * Make block number for *hp positive and add it to the translation list
  * 
@@ -924,7 +1588,6 @@ mf_trans_add(mfp, hp)
 {
 	BHDR		*freep;
 	blocknr_t	new;
-	int			hash;
 	NR_TRANS	*np;
 	int			page_count;
 
@@ -972,12 +1635,7 @@ mf_trans_add(mfp, hp)
 	hp->bh_bnum = new;
 	mf_ins_hash(mfp, hp);					/* insert in new hash list */
 
-	hash = MEMHASH(np->nt_old_bnum);		/* insert in trans list */
-	np->nt_next = mfp->mf_trans[hash];
-	mfp->mf_trans[hash] = np;
-	if (np->nt_next != NULL)
-		np->nt_next->nt_prev = np;
-	np->nt_prev = NULL;	
+	mf_hash_add_item(&mfp->mf_trans, (MF_HASHITEM *)np);	/* insert in trans list */
 
 	return OK;
 }
@@ -992,25 +1650,16 @@ mf_trans_del(mfp, old)
 	MEMFILE		*mfp;
 	blocknr_t	old;
 {
-	int			hash;
 	NR_TRANS	*np;
 	blocknr_t	new;
 
-	hash = MEMHASH(old);
-	for (np = mfp->mf_trans[hash]; np != NULL; np = np->nt_next)
-		if (np->nt_old_bnum == old)
-			break;
+	np = (NR_TRANS *)mf_hash_find(&mfp->mf_trans, old);
 	if (np == NULL)				/* not found */
 		return old;
 
 	mfp->mf_neg_count--;
 	new = np->nt_new_bnum;
-	if (np->nt_prev != NULL)			/* remove entry from the trans list */
-		np->nt_prev->nt_next = np->nt_next;
-	else
-		mfp->mf_trans[hash] = np->nt_next;
-	if (np->nt_next != NULL)
-		np->nt_next->nt_prev = np->nt_prev;
+	mf_hash_rem_item(&mfp->mf_trans, (MF_HASHITEM *)np);	/* remove entry from the trans list */
 	free(np);
 
 	return new;
@@ -1042,6 +1691,25 @@ mf_need_trans(mfp)
 	return (mfp->mf_fname != NULL && mfp->mf_neg_count > 0);
 }
 
+/*
+ * Change the page size of memfile "mfp", used when the guessed page size of
+ * an existing swap file was wrong.  The read-ahead buffer was read with the
+ * old page size, throw it away.
+ */
+	void
+mf_set_page_size(mfp, new_size)
+	MEMFILE		*mfp;
+	unsigned	new_size;
+{
+	if (mfp->mf_page_size == new_size)
+		return;
+	mfp->mf_page_size = new_size;
+	free(mfp->mf_ra_buf);
+	mfp->mf_ra_buf = NULL;
+	mfp->mf_ra_count = 0;
+	mfp->mf_ra_next = 0;
+}
+
 #if 1			/* included for beta release, TODO: remove later */
 /*
  * print statistics for a memfile (for debugging)
@@ -1056,6 +1724,7 @@ mf_statistics()
 	int			dirty = 0;
 	int			nfree = 0;
 	int			negative = 0;
+	long		nr_write, nr_write_pages, nr_fsync;
 
 	mfp = curbuf->b_ml.ml_mfp;
 	if (mfp == NULL)
@@ -1077,6 +1746,29 @@ mf_statistics()
 		sprintf((char *)IObuff, "%d used (%d locked, %d dirty, %d (%d) negative), %d free",
 						used, locked, dirty, negative, (int)mfp->mf_neg_count, nfree);
 		msg(IObuff);
+		sprintf((char *)IObuff, "%u pages (%u protected), %ld hit, %ld miss, %ld released",
+						mfp->mf_used_count, mfp->mf_prot_count, mfp->mf_nr_hit,
+						mfp->mf_nr_miss, mfp->mf_nr_release);
+		msg_outchar('\n');
+		msg_outstr(IObuff);
+
+			/* system calls for all swap files */
+#ifdef USE_PTHREAD
+		pthread_mutex_lock(&mf_job_mutex);	/* writer thread updates them */
+		nr_write = mf_nr_write + mf_nr_thread_write;
+		nr_write_pages = mf_nr_write_pages + mf_nr_thread_write_pages;
+		nr_fsync = mf_nr_fsync + mf_nr_thread_fsync;
+		pthread_mutex_unlock(&mf_job_mutex);
+#else
+		nr_write = mf_nr_write;
+		nr_write_pages = mf_nr_write_pages;
+		nr_fsync = mf_nr_fsync;
+#endif
+		sprintf((char *)IObuff, "%ld lseek, %ld read (%ld pages, %ld read-ahead), %ld write (%ld pages), %ld fsync",
+						mf_nr_seek, mf_nr_read, mf_nr_read_pages, mf_nr_ra_pages,
+						nr_write, nr_write_pages, nr_fsync);
+		msg_outchar('\n');
+		msg_outstr(IObuff);
 	}
 }
 #endif
@@ -1129,3 +1821,142 @@ mf_do_open(mfp, fname, new)
 		mfp->mf_xfname = NULL;
 	}
 }
+
+/*
+ * Implementation of the hash tables used for the block headers and the
+ * number translations.  See the comment at MF_HASHITEM in structs.h.
+ */
+
+/*
+ * initialize an empty hash table
+ */
+	static void
+mf_hash_init(mht)
+	MF_HASHTAB	*mht;
+{
+	int			i;
+
+	for (i = 0; i < MHT_INIT_SIZE; ++i)
+		mht->mht_small_buckets[i] = NULL;
+	mht->mht_buckets = mht->mht_small_buckets;
+	mht->mht_mask = MHT_INIT_SIZE - 1;
+	mht->mht_count = 0;
+}
+
+/*
+ * free the array of a hash table, the items must have been freed already
+ */
+	static void
+mf_hash_free(mht)
+	MF_HASHTAB	*mht;
+{
+	if (mht->mht_buckets != mht->mht_small_buckets)
+		free(mht->mht_buckets);
+	mf_hash_init(mht);
+}
+
+/*
+ * find the item with key 'key' in hash table *mht, NULL if not present
+ */
+	static MF_HASHITEM *
+mf_hash_find(mht, key)
+	MF_HASHTAB	*mht;
+	blocknr_t	key;
+{
+	MF_HASHITEM	*mhi;
+
+	mhi = mht->mht_buckets[(long_u)key & mht->mht_mask];
+	while (mhi != NULL && mhi->mhi_key != key)
+		mhi = mhi->mhi_next;
+	return mhi;
+}
+
+/*
+ * insert item *mhi in front of its hash list in hash table *mht
+ * The table grows when it becomes too full.
+ */
+	static void
+mf_hash_add_item(mht, mhi)
+	MF_HASHTAB	*mht;
+	MF_HASHITEM	*mhi;
+{
+	long_u		idx;
+
+	idx = (long_u)mhi->mhi_key & mht->mht_mask;
+	mhi->mhi_next = mht->mht_buckets[idx];
+	mhi->mhi_prev = NULL;
+	if (mhi->mhi_next != NULL)
+		mhi->mhi_next->mhi_prev = mhi;
+	mht->mht_buckets[idx] = mhi;
+
+	if (++mht->mht_count > mht->mht_mask + 1)
+		mf_hash_grow(mht);
+}
+
+/*
+ * remove item *mhi from hash table *mht
+ * The table never shrinks, a file that was big once is likely to grow again.
+ */
+	static void
+mf_hash_rem_item(mht, mhi)
+	MF_HASHTAB	*mht;
+	MF_HASHITEM	*mhi;
+{
+	if (mhi->mhi_prev == NULL)
+		mht->mht_buckets[(long_u)mhi->mhi_key & mht->mht_mask] = mhi->mhi_next;
+	else
+		mhi->mhi_prev->mhi_next = mhi->mhi_next;
+	if (mhi->mhi_next != NULL)
+		mhi->mhi_next->mhi_prev = mhi->mhi_prev;
+	--mht->mht_count;
+}
+
+/*
+ * Double the number of buckets in hash table *mht.
+ * Because the mask gets one more bit, the items in bucket 'i' are split
+ * between bucket 'i' and bucket 'i' + old size, keeping their order.
+ * When there is not enough memory the table just keeps its size, lookups
+ * will then be a bit slower.
+ */
+	static void
+mf_hash_grow(mht)
+	MF_HASHTAB	*mht;
+{
+	long_u		i;
+	long_u		size;
+	MF_HASHITEM	**buckets;
+	MF_HASHITEM	*mhi, *next;
+	MF_HASHITEM	*tails[2];
+	int			idx;
+
+	size = mht->mht_mask + 1;
+	buckets = (MF_HASHITEM **)lalloc((long_u)(size * 2 * sizeof(MF_HASHITEM *)),
+																	FALSE);
+	if (buckets == NULL)
+		return;
+
+	for (i = 0; i < size; ++i)
+	{
+		buckets[i] = NULL;
+		buckets[i + size] = NULL;
+		tails[0] = NULL;
+		tails[1] = NULL;
+		for (mhi = mht->mht_buckets[i]; mhi != NULL; mhi = next)
+		{
+			next = mhi->mhi_next;
+			idx = ((long_u)mhi->mhi_key & size) ? 1 : 0;
+			mhi->mhi_prev = tails[idx];
+			mhi->mhi_next = NULL;
+			if (tails[idx] == NULL)
+				buckets[i + idx * size] = mhi;
+			else
+				tails[idx]->mhi_next = mhi;
+			tails[idx] = mhi;
+		}
+	}
+
+	if (mht->mht_buckets != mht->mht_small_buckets)
+		free(mht->mht_buckets);
+	mht->mht_buckets = buckets;
+	mht->mht_mask = size * 2 - 1;
+}
@@ -38,6 +38,12 @@
  *    changed (lines appended/deleted/changd) or when it is flushed it gets
  *    a positive number. Use mf_trans_del() to get the new number, before
  *    calling mf_get().
+ *
+ *    When lines are appended at the end of a block, the block is filled
+ *    completely before a new one is used. This goes for data blocks and
+ *    pointer blocks (see ml_append_int()). Thus reading a file results in
+ *    full blocks and a tree of the smallest possible depth, without building
+ *    it in a separate pass.
  */
 
 /*
@@ -55,11 +61,16 @@
  * ml_get_buf()			get a pointer to a line in a specific buffer
  * ml_line_alloced()	return TRUE if line was allocated
  * ml_append()			append a new line
+ * ml_append_lines()	append several new lines
  * ml_replace()			replace a line
+ * ml_replace_lines()	replace several lines
  * ml_delete()			delete a line
  * ml_setmarked()		set mark for a line (for :global command)
  * ml_firstmarked()		get first line with a mark (for :global command)
  * ml_clearmarked()		clear all line marks (for :global command)
+ * ml_find_string()		find next line containing a string (for searching)
+ * ml_copy_block()		copy a data block (for searching in another thread)
+ * ml_block_line()		get a pointer to a line in a copied data block
  */
 
 #include "vim.h"
@@ -126,12 +137,9 @@ struct data_block
 };
 
 /*
- * The low bits of db_index hold the actual index. The topmost bit is
- * used for the global command to be able to mark a line. 
- * This method is not clean, but otherwise there would be at least one extra
- * byte used for each line.
- * The mark has to be in this place to keep it with the correct line when other
- * lines are inserted or deleted.
+ * The low bits of db_index hold the actual index. The topmost bit was used by
+ * older versions for the global command to mark a line. It is no longer set,
+ * but it is still masked off for swap files written by those versions.
  */
 #define DB_MARKED		((unsigned)1 << ((sizeof(unsigned) * 8) - 1))
 #define DB_INDEX_MASK	(~DB_MARKED)
@@ -153,12 +161,20 @@ struct block0
 #define STACK_INCR		5		/* number of entries added to ml_stack at a time */
 
 /*
- * The line number where the first mark may be is remembered.
- * If it is 0 there are no marks at all.
+ * The lines marked by the global command are kept in a sorted array of line
+ * numbers, instead of in the data blocks.  Entries before marked_next have
+ * been used already.  marked_delta must be added to the entries from
+ * marked_next onwards; inserting or deleting lines above all remaining marks,
+ * which is what the command executed for each line mostly does, only
+ * changes marked_delta.
  * (always used for the current buffer only, no buffer change possible while
  * executing a global command).
  */
-static linenr_t	lowest_marked = 0;
+static linenr_t	*marked_lnum = NULL;	/* the marked line numbers */
+static long		marked_size = 0;		/* allocated entries in marked_lnum */
+static long		marked_next = 0;		/* index of first unused entry */
+static long		marked_len = 0;			/* number of used entries */
+static linenr_t	marked_delta = 0;		/* added to entries from marked_next */
 
 /*
  * arguments for ml_find_line()
@@ -170,6 +186,7 @@ static linenr_t	lowest_marked = 0;
 #define ML_SIMPLE(x)	(x & 0x10)	/* DEL, INS or FIND */
 
 static int ml_append_int __ARGS((BUF *, linenr_t, char_u *, colnr_t, int));
+static int ml_append_lines_int __ARGS((BUF *, linenr_t, char_u **, colnr_t *, long, int));
 static int ml_delete_int __ARGS((BUF *, linenr_t, int));
 static char_u *findswapname __ARGS((BUF *, int));
 static void ml_flush_line __ARGS((BUF *));
@@ -179,6 +196,15 @@ static BHDR *ml_find_line __ARGS((BUF *, linenr_t, int));
 static int ml_add_stack __ARGS((BUF *));
 static char_u *makeswapname __ARGS((BUF *, int));
 static void ml_lineadd __ARGS((BUF *, int));
+static void ml_cache_clear __ARGS((BUF *));
+static BHDR *ml_cache_find __ARGS((BUF *, linenr_t));
+static void ml_cache_add __ARGS((BUF *, blocknr_t, int, linenr_t, linenr_t));
+static void ml_cache_adjust __ARGS((BUF *, linenr_t, long));
+static char_u *ml_memfind __ARGS((char_u *, char_u *, char_u *, int, int));
+static long ml_mark_find __ARGS((linenr_t));
+static void ml_mark_shift __ARGS((long, linenr_t));
+static void ml_mark_added __ARGS((linenr_t, long));
+static void ml_mark_deleted __ARGS((linenr_t));
 
 /*
  * open a new memline for 'curbuf'
@@ -205,6 +231,7 @@ ml_open()
 	curbuf->b_ml.ml_stack_top = 0;		/* nothing in the stack */
 	curbuf->b_ml.ml_locked = NULL;		/* no cached block */
 	curbuf->b_ml.ml_line_lnum = 0;		/* no cached line */
+	ml_cache_clear(curbuf);				/* no blocks remembered */
 
 /*
  * make fname for swap file
@@ -621,6 +648,7 @@ ml_recover()
 	buf->b_ml.ml_line_lnum = 0;			/* no cached line */
 	buf->b_ml.ml_locked = NULL;			/* no locked block */
 	buf->b_ml.ml_flags = 0;
+	ml_cache_clear(buf);				/* no blocks remembered */
 
 /*
  * open the memfile from the old swap file
@@ -657,7 +685,7 @@ ml_recover()
 	 */
 	if (mfp->mf_page_size != b0p->b0_page_size)
 	{
-		mfp->mf_page_size = b0p->b0_page_size;
+		mf_set_page_size(mfp, (unsigned)b0p->b0_page_size);
 		if ((size = lseek(mfp->mf_fd, 0L, SEEK_END)) <= 0)
 			mfp->mf_blocknr_max = 0;		/* no file or empty file */
 		else
@@ -1250,6 +1278,8 @@ ml_preserve(buf, message)
 	 */
 	if (mf_need_trans(mfp))
 	{
+			/* the cache would skip the pointer blocks */
+		ml_cache_clear(buf);
 		lnum = 1;
 		while (mf_need_trans(mfp) && lnum <= buf->b_ml.ml_line_count)
 		{
@@ -1380,6 +1410,9 @@ ml_line_alloced()
  *   newfile: TRUE when starting to edit a new file, meaning that pe_old_lnum
  *				will be set for recovery
  *
+ * When 'len' is given, the byte at line[len - 1] is not copied, a NUL is
+ * stored instead. Thus readfile() can pass a line that ends in a newline.
+ *
  * return FAIL for failure, OK otherwise
  */
 	int
@@ -1420,8 +1453,8 @@ ml_append_int(buf, lnum, line, len, newfile)
 	if (lnum > buf->b_ml.ml_line_count || buf->b_ml.ml_mfp == NULL)
 		return FAIL;
 	
-	if (lowest_marked && lowest_marked > lnum)
-		lowest_marked = lnum + 1;
+	if (buf == curbuf)
+		ml_mark_added(lnum, 1L);
 
 	if (len == 0)
 		len = STRLEN(line) + 1;			/* space needed for the text */
@@ -1516,7 +1549,9 @@ ml_append_int(buf, lnum, line, len, newfile)
 		/*
 		 * copy the text into the block
 		 */
-		memmove((char *)dp + dp->db_index[db_idx + 1], (char *)line, (size_t)len);
+		memmove((char *)dp + dp->db_index[db_idx + 1], (char *)line,
+															(size_t)len - 1);
+		*((char_u *)dp + dp->db_index[db_idx + 1] + len - 1) = NUL;
 
 		/*
 		 * Mark the block dirty.
@@ -1628,7 +1663,9 @@ ml_append_int(buf, lnum, line, len, newfile)
 			dp_right->db_txt_start -= len;
 			dp_right->db_free -= len + INDEX_SIZE;
 			dp_right->db_index[0] = dp_right->db_txt_start;
-			memmove((char *)dp_right + dp_right->db_txt_start, (char *)line, (size_t)len);
+			memmove((char *)dp_right + dp_right->db_txt_start, (char *)line,
+															(size_t)len - 1);
+			*((char_u *)dp_right + dp_right->db_txt_start + len - 1) = NUL;
 			++line_count_right;
 		}
 		/*
@@ -1665,7 +1702,8 @@ ml_append_int(buf, lnum, line, len, newfile)
 			dp_left->db_free -= len + INDEX_SIZE;
 			dp_left->db_index[line_count_left] = dp_left->db_txt_start;
 			memmove((char *)dp_left + dp_left->db_txt_start, (char *)line,
-										(size_t)len);
+										(size_t)len - 1);
+			*((char_u *)dp_left + dp_left->db_txt_start + len - 1) = NUL;
 			++line_count_left;
 		}
 
@@ -1758,6 +1796,7 @@ ml_append_int(buf, lnum, line, len, newfile)
 					++(buf->b_ml.ml_stack_top);
 				}
 
+				ml_cache_adjust(buf, lnum == 0 ? (linenr_t)1 : lnum, 1L);
 				return OK;
 			}
 			else						/* pointer block full */
@@ -1800,6 +1839,7 @@ ml_append_int(buf, lnum, line, len, newfile)
 				/*
 				 * move the pointers after the current one to the new block
 				 * If there are none, the new entry will be in the new block.
+				 * Thus when appending at the end the old block stays full.
 				 */
 				total_moved = pp->pb_count - pb_idx - 1;
 				if (total_moved)
@@ -1852,6 +1892,165 @@ ml_append_int(buf, lnum, line, len, newfile)
 		EMSG("Updated too many blocks?");
 		buf->b_ml.ml_stack_top = 0;		/* invalidate stack */
 	}
+	ml_cache_adjust(buf, lnum == 0 ? (linenr_t)1 : lnum, 1L);
+	return OK;
+}
+
+/*
+ * Append "count" lines after lnum (may be 0 to insert in front of the file).
+ * "lines" points to the text of the lines. When "lens" is not NULL, it has
+ * the length of each line like for ml_append(), otherwise the lines are NUL
+ * terminated.
+ * This is faster than calling ml_append() for each line: The data block
+ * is looked up once and filled with as many lines as fit in it.
+ *
+ * return FAIL for failure, OK otherwise
+ */
+	int
+ml_append_lines(lnum, lines, lens, count, newfile)
+	linenr_t	lnum;			/* append after this line (can be 0) */
+	char_u		**lines;		/* text of the new lines */
+	colnr_t		*lens;			/* lengths of the lines, including NUL */
+	long		count;			/* number of lines */
+	int			newfile;		/* flag, see ml_append() */
+{
+ 	if (curbuf->b_ml.ml_line_lnum != 0)
+		ml_flush_line(curbuf);
+	return ml_append_lines_int(curbuf, lnum, lines, lens, count, newfile);
+}
+
+	static int
+ml_append_lines_int(buf, lnum, lines, lens, count, newfile)
+	BUF			*buf;
+	linenr_t	lnum;
+	char_u		**lines;
+	colnr_t		*lens;
+	long		count;
+	int			newfile;
+{
+	int			i;
+	int			n;				/* number of lines that fit in block */
+	int			line_count;		/* number of indexes in current block */
+	int			db_idx;			/* index for lnum in data block */
+	int			free_space;
+	int			total_len;		/* text length of the "n" lines */
+	int			offset;
+	colnr_t		len;
+	BHDR		*hp;
+	DATA_BL		*dp;
+
+	while (count > 0)
+	{
+		if (lnum > buf->b_ml.ml_line_count || buf->b_ml.ml_mfp == NULL)
+			return FAIL;
+
+		/*
+		 * Find the data block with the line to append after and count the
+		 * lines that fit in it.
+		 */
+		if ((hp = ml_find_line(buf, lnum == 0 ? (linenr_t)1 : lnum,
+														ML_FIND)) == NULL)
+			return FAIL;
+		dp = (DATA_BL *)(hp->bh_data);
+		free_space = dp->db_free;
+		total_len = 0;
+		for (n = 0; n < count; ++n)
+		{
+			len = (lens == NULL) ? STRLEN(lines[n]) + 1 : lens[n];
+			if (free_space < (int)len + (int)INDEX_SIZE)
+				break;
+			free_space -= len + INDEX_SIZE;
+			total_len += len;
+		}
+
+		/*
+		 * When not even one line fits, ml_append_int() splits the block or
+		 * uses the next one.
+		 */
+		if (n == 0)
+		{
+			if (ml_append_int(buf, lnum, lines[0],
+								lens == NULL ? (colnr_t)0 : lens[0], newfile) == FAIL)
+				return FAIL;
+			++lnum;
+			++lines;
+			if (lens != NULL)
+				++lens;
+			--count;
+			continue;
+		}
+
+		if (buf == curbuf)
+			ml_mark_added(lnum, (long)n);
+
+		/*
+		 * ML_INSERT gets the same block again and adds one line to the
+		 * counts, the others are added to ml_locked_lineadd.  When the block
+		 * came from ml_cache it is looked up from the root again, to fill the
+		 * stack.
+		 */
+		if ((hp = ml_find_line(buf, lnum == 0 ? (linenr_t)1 : lnum,
+														ML_INSERT)) == NULL)
+			return FAIL;
+		dp = (DATA_BL *)(hp->bh_data);
+				/* get line count before the insertion */
+		line_count = buf->b_ml.ml_locked_high - buf->b_ml.ml_locked_low;
+		if (lnum == 0)
+			db_idx = -1;			/* careful, it is negative! */
+		else
+			db_idx = lnum - buf->b_ml.ml_locked_low;
+		buf->b_ml.ml_locked_lineadd += n - 1;
+		buf->b_ml.ml_locked_high += n - 1;
+		buf->b_ml.ml_line_count += n;
+		buf->b_ml.ml_flags &= ~ML_EMPTY;
+
+		dp->db_txt_start -= total_len;
+		dp->db_free -= total_len + n * INDEX_SIZE;
+		dp->db_line_count += n;
+
+		/*
+		 * Move the text of the lines that follow to the front and adjust
+		 * their indexes, like ml_append_int() does for one line.
+		 * "offset" is where the text of the new lines ends.
+		 */
+		if (line_count > db_idx + 1)		/* if there are following lines */
+		{
+			if (db_idx < 0)
+				offset = dp->db_txt_end;
+			else
+				offset = ((dp->db_index[db_idx]) & DB_INDEX_MASK);
+			memmove((char *)dp + dp->db_txt_start,
+							(char *)dp + dp->db_txt_start + total_len,
+							(size_t)(offset - (dp->db_txt_start + total_len)));
+			for (i = line_count - 1; i > db_idx; --i)
+				dp->db_index[i + n] = dp->db_index[i] - total_len;
+		}
+		else								/* add lines at the end */
+			offset = dp->db_txt_start + total_len;
+
+		/*
+		 * copy the text of the new lines into the block
+		 */
+		for (i = 0; i < n; ++i)
+		{
+			len = (lens == NULL) ? STRLEN(lines[i]) + 1 : lens[i];
+			offset -= len;
+			dp->db_index[db_idx + 1 + i] = offset;
+			memmove((char *)dp + offset, (char *)lines[i], (size_t)len - 1);
+			*((char_u *)dp + offset + len - 1) = NUL;
+		}
+
+		buf->b_ml.ml_flags |= ML_LOCKED_DIRTY;
+		if (!newfile)
+			buf->b_ml.ml_flags |= ML_LOCKED_POS;
+		ml_cache_adjust(buf, lnum == 0 ? (linenr_t)1 : lnum, (long)n);
+
+		lnum += n;
+		lines += n;
+		if (lens != NULL)
+			lens += n;
+		count -= n;
+	}
 	return OK;
 }
 
@@ -1885,6 +2084,105 @@ ml_replace(lnum, line, copy)
 	return OK;
 }
 
+/*
+ * replace 'count' lines from 'lnum' on in current buffer
+ *
+ * The lines in 'lines' must have been allocated, they are freed.  The lines
+ * that are in the same data block are put in it with one move of the text of
+ * the following lines, ml_replace() moves it for every line.
+ *
+ * return FAIL for failure, OK otherwise
+ */
+	int
+ml_replace_lines(lnum, lines, count)
+	linenr_t	lnum;
+	char_u		**lines;
+	long		count;
+{
+	BUF			*buf = curbuf;
+	BHDR		*hp;
+	DATA_BL		*dp;
+	int			n;				/* number of lines in this block */
+	int			idx;			/* index of lnum in data block */
+	int			i;
+	int			extra;			/* text gets longer by this much */
+	int			start;			/* start of the text of the last line */
+	int			offset;
+	int			line_count;
+	colnr_t		len;
+	int			retval = OK;
+
+	while (count > 0)
+	{
+		ml_flush_line(buf);
+		if ((hp = ml_find_line(buf, lnum, ML_FIND)) == NULL)
+		{
+			retval = FAIL;
+			break;
+		}
+		dp = (DATA_BL *)(hp->bh_data);
+		idx = lnum - buf->b_ml.ml_locked_low;
+		line_count = buf->b_ml.ml_locked_high - buf->b_ml.ml_locked_low + 1;
+		n = line_count - idx;
+		if (n > count)
+			n = count;
+
+		/* the text of lines idx to idx + n - 1 is between start and offset */
+		start = (dp->db_index[idx + n - 1] & DB_INDEX_MASK);
+		if (idx == 0)
+			offset = dp->db_txt_end;
+		else
+			offset = (dp->db_index[idx - 1] & DB_INDEX_MASK);
+		extra = -(offset - start);
+		for (i = 0; i < n; ++i)
+			extra += STRLEN(lines[i]) + 1;
+
+		/*
+		 * If the new lines don't fit in the data block, let ml_flush_line()
+		 * split it for the first one.
+		 */
+		if ((int)dp->db_free < extra)
+		{
+			ml_replace(lnum, lines[0], FALSE);
+			++lnum;
+			++lines;
+			--count;
+			continue;
+		}
+
+			/* move text of following lines and adjust their pointers */
+		if (extra != 0 && idx + n < line_count)
+		{
+			memmove((char *)dp + dp->db_txt_start - extra,
+								(char *)dp + dp->db_txt_start,
+								(size_t)(start - dp->db_txt_start));
+			for (i = idx + n; i < line_count; ++i)
+				dp->db_index[i] -= extra;
+		}
+		dp->db_free -= extra;
+		dp->db_txt_start -= extra;
+
+			/* copy the new lines into the data block */
+		for (i = 0; i < n; ++i)
+		{
+			len = STRLEN(lines[i]) + 1;
+			offset -= len;
+			memmove((char *)dp + offset, (char *)lines[i], (size_t)len);
+			dp->db_index[idx + i] = offset;
+			free(lines[i]);
+		}
+		buf->b_ml.ml_flags |= (ML_LOCKED_DIRTY | ML_LOCKED_POS);
+
+		lnum += n;
+		lines += n;
+		count -= n;
+	}
+	ml_flush_line(buf);
+	while (--count >= 0)			/* free lines not used after a failure */
+		free(*lines++);
+	return retval;
+}
+
 /*
  * delete line 'lnum'
  *
@@ -1921,8 +2219,8 @@ ml_delete_int(buf, lnum, message)
 	if (lnum < 1 || lnum > buf->b_ml.ml_line_count)
 		return FAIL;
 
-	if (lowest_marked && lowest_marked > lnum)
-		lowest_marked--;
+	if (buf == curbuf)
+		ml_mark_deleted(lnum);
 
 /*
  * If the file becomes empty the last line is replaced by an empty line.
@@ -1954,6 +2252,7 @@ ml_delete_int(buf, lnum, message)
 	idx = lnum - buf->b_ml.ml_locked_low;
 
 	--buf->b_ml.ml_line_count;
+	ml_cache_adjust(buf, lnum, -1L);
 
 /*
  * special case: If there is only one line in the data block it becomes empty.
@@ -2043,77 +2342,144 @@ ml_delete_int(buf, lnum, message)
 }
 
 /*
- * set the B_MARKED flag for line 'lnum'
+ * Return the index of the first unused entry in marked_lnum[] for a line at or
+ * below 'lnum', marked_len if there is none.
+ */
+	static long
+ml_mark_find(lnum)
+	linenr_t	lnum;
+{
+	long		lo, hi, mid;
+
+	lo = marked_next;
+	hi = marked_len;
+	while (lo < hi)
+	{
+		mid = (lo + hi) / 2;
+		if (marked_lnum[mid] + marked_delta < lnum)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/*
+ * Add 'amount' to the marked lines from index 'idx' onwards.
+ */
+	static void
+ml_mark_shift(idx, amount)
+	long		idx;
+	linenr_t	amount;
+{
+	if (idx == marked_next)
+		marked_delta += amount;
+	else
+		for ( ; idx < marked_len; ++idx)
+			marked_lnum[idx] += amount;
+}
+
+/*
+ * 'count' lines have been inserted below line 'lnum': adjust the marks.
+ */
+	static void
+ml_mark_added(lnum, count)
+	linenr_t	lnum;
+	long		count;
+{
+	if (marked_next < marked_len)
+		ml_mark_shift(ml_mark_find(lnum + 1), (linenr_t)count);
+}
+
+/*
+ * Line 'lnum' is going to be deleted: remove its mark and adjust the others.
+ */
+	static void
+ml_mark_deleted(lnum)
+	linenr_t	lnum;
+{
+	long		idx;
+
+	if (marked_next == marked_len)
+		return;
+	idx = ml_mark_find(lnum);
+	if (idx < marked_len && marked_lnum[idx] + marked_delta == lnum)
+	{
+		if (idx == marked_next)
+			idx = ++marked_next;
+		else
+		{
+			memmove((char *)(marked_lnum + idx), (char *)(marked_lnum + idx + 1),
+						(size_t)(marked_len - idx - 1) * sizeof(linenr_t));
+			--marked_len;
+		}
+	}
+	ml_mark_shift(idx, (linenr_t)-1);
+}
+
+/*
+ * set the mark for line 'lnum'
  */
 	void
 ml_setmarked(lnum)
-	linenr_t lnum;
+	linenr_t	lnum;
 {
-	BHDR	*hp;
-	DATA_BL	*dp;
+	long		idx;
+	linenr_t	*p;
 									/* invalid line number */
 	if (lnum < 1 || lnum > curbuf->b_ml.ml_line_count ||
 												curbuf->b_ml.ml_mfp == NULL)
 		return;						/* give error message? */
 
-	if (lowest_marked == 0 || lowest_marked > lnum)
-		lowest_marked = lnum;
-
 	/*
-	 * find the data block containing the line
-	 * This also fills the stack with the blocks from the root to the data block
-	 * This also releases any locked block.
+	 * Lines are mostly marked in ascending order, check the last one first.
 	 */
-	if ((hp = ml_find_line(curbuf, lnum, ML_FIND)) == NULL)
-		return;				/* give error message? */
+	if (marked_next == marked_len ||
+						marked_lnum[marked_len - 1] + marked_delta < lnum)
+		idx = marked_len;
+	else
+	{
+		idx = ml_mark_find(lnum);
+		if (marked_lnum[idx] + marked_delta == lnum)
+			return;					/* already marked */
+		if (idx == marked_next && marked_next > 0)
+		{
+			marked_lnum[--marked_next] = lnum - marked_delta;
+			return;
+		}
+	}
 
-	dp = (DATA_BL *)(hp->bh_data);
-	dp->db_index[lnum - curbuf->b_ml.ml_locked_low] |= DB_MARKED;
-	curbuf->b_ml.ml_flags |= ML_LOCKED_DIRTY;
+	if (marked_len == marked_size)
+	{
+		p = (linenr_t *)lalloc((long_u)(sizeof(linenr_t) *
+					(marked_size == 0 ? 1000 : marked_size * 2)), TRUE);
+		if (p == NULL)
+			return;
+		if (marked_lnum != NULL)
+		{
+			memmove((char *)p, (char *)marked_lnum,
+									(size_t)marked_len * sizeof(linenr_t));
+			free(marked_lnum);
+		}
+		marked_lnum = p;
+		marked_size = (marked_size == 0 ? 1000 : marked_size * 2);
+	}
+	if (idx < marked_len)
+		memmove((char *)(marked_lnum + idx + 1), (char *)(marked_lnum + idx),
+						(size_t)(marked_len - idx) * sizeof(linenr_t));
+	marked_lnum[idx] = lnum - marked_delta;
+	++marked_len;
 }
 
 /*
- * find the first line with its B_MARKED flag set
+ * find the first line with a mark and remove its mark
  */
 	linenr_t
 ml_firstmarked()
 {
-	BHDR		*hp;
-	DATA_BL		*dp;
-	linenr_t	lnum;
-	int			i;
-
-	if (curbuf->b_ml.ml_mfp == NULL)
+	if (curbuf->b_ml.ml_mfp == NULL || marked_next == marked_len)
 		return (linenr_t) 0;
-
-	/*
-	 * The search starts with lowest_marked line. This is the last line where
-	 * a mark was found, adjusted by inserting/deleting lines.
-	 */
-	for (lnum = lowest_marked; lnum <= curbuf->b_ml.ml_line_count; )
-	{
-		/*
-		 * Find the data block containing the line.
-		 * This also fills the stack with the blocks from the root to the data
-		 * block This also releases any locked block.
-		 */
-		if ((hp = ml_find_line(curbuf, lnum, ML_FIND)) == NULL)
-			return (linenr_t)0;				/* give error message? */
-
-		dp = (DATA_BL *)(hp->bh_data);
-
-		for (i = lnum - curbuf->b_ml.ml_locked_low;
-							lnum <= curbuf->b_ml.ml_locked_high; ++i, ++lnum)
-			if ((dp->db_index[i]) & DB_MARKED)
-			{
-				(dp->db_index[i]) &= DB_INDEX_MASK;
-				curbuf->b_ml.ml_flags |= ML_LOCKED_DIRTY;
-				lowest_marked = lnum + 1;
-				return lnum;
-			}
-	}
-
-	return (linenr_t) 0;
+	return marked_lnum[marked_next++] + marked_delta;
 }
 
 /*
@@ -2123,57 +2489,225 @@ ml_firstmarked()
 ml_has_mark(lnum)
 	linenr_t	lnum;
 {
-	BHDR		*hp;
-	DATA_BL		*dp;
-
-	if (curbuf->b_ml.ml_mfp == NULL ||
-						(hp = ml_find_line(curbuf, lnum, ML_FIND)) == NULL)
-		return FALSE;
+	long		idx;
 
-	dp = (DATA_BL *)(hp->bh_data);
-	return (int)((dp->db_index[lnum - curbuf->b_ml.ml_locked_low]) & DB_MARKED);
+	idx = ml_mark_find(lnum);
+	return (idx < marked_len && marked_lnum[idx] + marked_delta == lnum);
 }
 
 /*
- * clear all DB_MARKED flags
+ * clear all marks
  */
 	void
 ml_clearmarked()
+{
+	if (marked_lnum != NULL)
+		free(marked_lnum);
+	marked_lnum = NULL;
+	marked_size = 0;
+	marked_next = 0;
+	marked_len = 0;
+	marked_delta = 0;
+}
+
+/*
+ * Find the first line from 'lnum' to 'last' in direction 'dir' (FORWARD or
+ * BACKWARD) that contains 'str', ignoring case if 'ic' is TRUE.
+ * Instead of getting each line with ml_get(), the text of a data block is
+ * searched in one pass. The position of a match is turned into a line
+ * number with db_index[]. Each data block is used only once.
+ *
+ * return: line number, 0 if not found or interrupted
+ */
+	linenr_t
+ml_find_string(lnum, last, dir, str, ic)
+	linenr_t	lnum;
+	linenr_t	last;
+	int			dir;
+	char_u		*str;
+	int			ic;
 {
 	BHDR		*hp;
 	DATA_BL		*dp;
-	linenr_t	lnum;
-	int			i;
+	char_u		*start;		/* text of line furthest in search direction */
+	char_u		*end;		/* end of text of 'lnum' */
+	char_u		*p;
+	char_u		*found;
+	int			len;
+	int			idx;
+	int			first, lastidx;
+	unsigned	off;
 
-	if (curbuf->b_ml.ml_mfp == NULL)		/* nothing to do */
-		return;
+	if (curbuf->b_ml.ml_mfp == NULL || (dir == FORWARD ? lnum > last : lnum < last))
+		return (linenr_t)0;
 
-	/*
-	 * The search starts with line lowest_marked.
-	 */
-	for (lnum = lowest_marked; lnum <= curbuf->b_ml.ml_line_count; )
+	ml_flush_line(curbuf);		/* make sure changed line is in its block */
+	len = STRLEN(str);
+	while (dir == FORWARD ? lnum <= last : lnum >= last)
 	{
-		/*
-		 * Find the data block containing the line.
-		 * This also fills the stack with the blocks from the root to the data block
-		 * This also releases any locked block.
-		 */
 		if ((hp = ml_find_line(curbuf, lnum, ML_FIND)) == NULL)
-			return;				/* give error message? */
-
+			return (linenr_t)0;
 		dp = (DATA_BL *)(hp->bh_data);
 
-		for (i = lnum - curbuf->b_ml.ml_locked_low;
-							lnum <= curbuf->b_ml.ml_locked_high; ++i, ++lnum)
-			if ((dp->db_index[i]) & DB_MARKED)
+		/*
+		 * The lines in the block from 'lnum' up to 'last' or the end of the
+		 * block, in the search direction, are from index 'first' to 'lastidx'.
+		 * The text of lastidx comes first in the block.
+		 */
+		first = lnum - curbuf->b_ml.ml_locked_low;
+		if (dir == FORWARD)
+			lastidx = (last < curbuf->b_ml.ml_locked_high ? last
+									: curbuf->b_ml.ml_locked_high)
+												- curbuf->b_ml.ml_locked_low;
+		else
+			lastidx = (last > curbuf->b_ml.ml_locked_low ? last
+									: curbuf->b_ml.ml_locked_low)
+												- curbuf->b_ml.ml_locked_low;
+		if (dir == FORWARD)
+		{
+			start = (char_u *)dp + (dp->db_index[lastidx] & DB_INDEX_MASK);
+			end = (char_u *)dp + (first == 0 ? dp->db_txt_end
+								: (dp->db_index[first - 1] & DB_INDEX_MASK));
+		}
+		else
+		{
+			start = (char_u *)dp + (dp->db_index[first] & DB_INDEX_MASK);
+			end = (char_u *)dp + (lastidx == 0 ? dp->db_txt_end
+								: (dp->db_index[lastidx - 1] & DB_INDEX_MASK));
+		}
+
+		/*
+		 * Going backward the first match in the text is in the wanted line.
+		 * Going forward it's the last match, thus find all of them.
+		 */
+		found = NULL;
+		for (p = start; (p = ml_memfind(p, end, str, len, ic)) != NULL; ++p)
+		{
+			found = p;
+			if (dir == BACKWARD)
+				break;
+		}
+		if (found != NULL)
+		{
+			/*
+			 * db_index[] decreases with the line number: binary search for
+			 * the first line that starts at or before the match.
+			 */
+			off = found - (char_u *)dp;
+			if (dir == BACKWARD)
+				idx = first, first = lastidx, lastidx = idx;
+			while (first < lastidx)
 			{
-				(dp->db_index[i]) &= DB_INDEX_MASK;
-				curbuf->b_ml.ml_flags |= ML_LOCKED_DIRTY;
+				idx = (first + lastidx) / 2;
+				if ((dp->db_index[idx] & DB_INDEX_MASK) <= off)
+					lastidx = idx;
+				else
+					first = idx + 1;
 			}
+			return curbuf->b_ml.ml_locked_low + first;
+		}
+
+		if (dir == FORWARD)
+			lnum = curbuf->b_ml.ml_locked_high + 1;
+		else
+			lnum = curbuf->b_ml.ml_locked_low - 1;
+		breakcheck();
+		if (got_int)
+			return (linenr_t)0;
 	}
+	return (linenr_t)0;
+}
 
-	lowest_marked = 0;
-	return;
+/*
+ * Find the first occurrence of 'str' (with length 'len') in the text from
+ * 'p' to 'end'. The text may contain NULs. Ignore case when 'ic' is TRUE.
+ */
+	static char_u *
+ml_memfind(p, end, str, len, ic)
+	char_u		*p;
+	char_u		*end;
+	char_u		*str;
+	int			len;
+	int			ic;
+{
+	int			c;
+
+	end -= len;
+	c = TO_UPPER(*str);
+	for ( ; p <= end; ++p)
+	{
+		if (ic)
+		{
+			while (p <= end && TO_UPPER(*p) != c)
+				++p;
+			if (p > end)
+				break;
+			if (vim_strnicmp(p, str, (size_t)len) == 0)
+				return p;
+		}
+		else
+		{
+			if ((p = (char_u *)memchr((char *)p, *str,
+										(size_t)(end - p + 1))) == NULL)
+				break;
+			if (memcmp((char *)p, (char *)str, (size_t)len) == 0)
+				return p;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Copy the data block that contains line 'lnum' to '*blockp', which has
+ * '*sizep' bytes allocated and is made bigger when needed.  The first and
+ * last line in the block are stored in '*lowp' and '*highp'.  Use
+ * ml_block_line() to get the lines from the copy.
+ *
+ * return FAIL for failure, OK otherwise
+ */
+	int
+ml_copy_block(lnum, blockp, sizep, lowp, highp)
+	linenr_t	lnum;
+	char_u		**blockp;
+	unsigned	*sizep;
+	linenr_t	*lowp;
+	linenr_t	*highp;
+{
+	BHDR		*hp;
+	DATA_BL		*dp;
+
+	if (curbuf->b_ml.ml_mfp == NULL)
+		return FAIL;
+	ml_flush_line(curbuf);		/* make sure changed line is in its block */
+	if ((hp = ml_find_line(curbuf, lnum, ML_FIND)) == NULL)
+		return FAIL;
+	dp = (DATA_BL *)(hp->bh_data);
+	if (dp->db_txt_end > *sizep)
+	{
+		free(*blockp);
+		*sizep = 0;
+		if ((*blockp = lalloc((long_u)dp->db_txt_end, TRUE)) == NULL)
+			return FAIL;
+		*sizep = dp->db_txt_end;
+	}
+	memmove((char *)*blockp, (char *)dp, (size_t)dp->db_txt_end);
+	*lowp = curbuf->b_ml.ml_locked_low;
+	*highp = curbuf->b_ml.ml_locked_high;
+	return OK;
+}
+
+/*
+ * Get a pointer to the text of line 'lnum' in a data block copied with
+ * ml_copy_block(), 'low' is the first line in the block.
+ * Doesn't use any global variables, can be called from another thread.
+ */
+	char_u *
+ml_block_line(block, low, lnum)
+	char_u		*block;
+	linenr_t	low;
+	linenr_t	lnum;
+{
+	return block + (((DATA_BL *)block)->db_index[lnum - low] & DB_INDEX_MASK);
 }
 
 /*
@@ -2318,7 +2852,8 @@ ml_new_ptr(mfp)
  *			 if ML_FIND just find the line
  *
  * If the block was found it is locked and put in ml_locked.
- * The stack is updated to lead to the locked block. The ip_high field in
+ * For ML_FIND the block may be found in ml_cache, the stack is then empty.
+ * Otherwise the stack is updated to lead to the locked block. The ip_high field in
  * the stack is updated to reflect the last line in the block AFTER the
  * insert or delete, also if the pointer block has not been updated yet. But
  * if if ml_locked != NULL ml_locked_lineadd must be added to ip_high.
@@ -2351,11 +2886,14 @@ ml_find_line(buf, lnum, action)
 	 * If not, flush and release the locked block.
 	 * Don't do this for ML_INSERT_SAME, because the stack need to be updated.
 	 * Don't do this for ML_FLUSH, because we want to flush the locked block.
+	 * Don't do this for ML_INSERT or ML_DELETE when the block was found in
+	 * ml_cache, because then there is no stack to update the pointer blocks.
 	 */
 	if (buf->b_ml.ml_locked)
 	{
 		if (ML_SIMPLE(action) && buf->b_ml.ml_locked_low <= lnum &&
-									buf->b_ml.ml_locked_high >= lnum)
+									buf->b_ml.ml_locked_high >= lnum &&
+						(action == ML_FIND || buf->b_ml.ml_stack_top > 0))
 		{
 				/* remember to update pointer blocks and stack later */
 			if (action == ML_INSERT)
@@ -2386,6 +2924,9 @@ ml_find_line(buf, lnum, action)
 	if (action == ML_FLUSH)			/* nothing else to do */
 		return NULL;
 
+	if (action == ML_FIND && (hp = ml_cache_find(buf, lnum)) != NULL)
+		return hp;
+
 	bnum = 1;						/* start at the root of the tree */
 	page_count = 1;
 	low = 1;
@@ -2435,6 +2976,8 @@ ml_find_line(buf, lnum, action)
 			buf->b_ml.ml_locked_high = high;
 			buf->b_ml.ml_locked_lineadd = 0;
 			buf->b_ml.ml_flags &= ~(ML_LOCKED_DIRTY | ML_LOCKED_POS);
+			if (action == ML_FIND)
+				ml_cache_add(buf, bnum, page_count, low, high);
 			return hp;
 		}
 
@@ -2594,6 +3137,124 @@ ml_lineadd(buf, count)
 	}
 }
 
+/*
+ * Forget all data blocks remembered in ml_cache.
+ */
+	static void
+ml_cache_clear(buf)
+	BUF			*buf;
+{
+	int			i;
+
+	for (i = 0; i < ML_CACHE_SIZE; ++i)
+		buf->b_ml.ml_cache[i].mc_bnum = 0;
+	buf->b_ml.ml_cache_next = 0;
+}
+
+/*
+ * Find line 'lnum' in the data blocks remembered in ml_cache.
+ * If found the block is locked like ml_find_line() does, but the stack is
+ * made empty, it does not lead to the block.
+ *
+ * return: NULL if not found, pointer to block header otherwise
+ */
+	static BHDR *
+ml_cache_find(buf, lnum)
+	BUF			*buf;
+	linenr_t	lnum;
+{
+	MLCACHE		*mc;
+	BHDR		*hp;
+	DATA_BL		*dp;
+	int			i;
+
+	for (i = 0; i < ML_CACHE_SIZE; ++i)
+	{
+		mc = &(buf->b_ml.ml_cache[i]);
+		if (mc->mc_bnum == 0 || mc->mc_low > lnum || mc->mc_high < lnum)
+			continue;
+
+		/*
+		 * A negative block number that has been translated or a block that
+		 * does not contain these lines anymore can not be used, forget it.
+		 */
+		if ((hp = mf_get(buf->b_ml.ml_mfp, mc->mc_bnum,
+												mc->mc_page_count)) == NULL)
+		{
+			mc->mc_bnum = 0;
+			return NULL;
+		}
+		dp = (DATA_BL *)(hp->bh_data);
+		if (dp->db_id != DATA_ID ||
+					dp->db_line_count != mc->mc_high - mc->mc_low + 1)
+		{
+			mf_put(buf->b_ml.ml_mfp, hp, FALSE, FALSE);
+			mc->mc_bnum = 0;
+			return NULL;
+		}
+
+		buf->b_ml.ml_locked = hp;
+		buf->b_ml.ml_locked_low = mc->mc_low;
+		buf->b_ml.ml_locked_high = mc->mc_high;
+		buf->b_ml.ml_locked_lineadd = 0;
+		buf->b_ml.ml_flags &= ~(ML_LOCKED_DIRTY | ML_LOCKED_POS);
+		buf->b_ml.ml_stack_top = 0;
+		return hp;
+	}
+	return NULL;
+}
+
+/*
+ * Remember that data block 'bnum' contains lines 'low' to 'high'.
+ * The oldest entry in ml_cache is replaced.
+ */
+	static void
+ml_cache_add(buf, bnum, page_count, low, high)
+	BUF			*buf;
+	blocknr_t	bnum;
+	int			page_count;
+	linenr_t	low, high;
+{
+	MLCACHE		*mc;
+
+	mc = &(buf->b_ml.ml_cache[buf->b_ml.ml_cache_next]);
+	mc->mc_bnum = bnum;
+	mc->mc_page_count = page_count;
+	mc->mc_low = low;
+	mc->mc_high = high;
+	if (++(buf->b_ml.ml_cache_next) == ML_CACHE_SIZE)
+		buf->b_ml.ml_cache_next = 0;
+}
+
+/*
+ * Update ml_cache after the block with line 'lnum' was changed and the
+ * lines below 'lnum' have moved 'count' lines down (up when negative).
+ * The changed block may have been split or freed, it is forgotten.
+ */
+	static void
+ml_cache_adjust(buf, lnum, count)
+	BUF			*buf;
+	linenr_t	lnum;
+	long		count;
+{
+	MLCACHE		*mc;
+	int			i;
+
+	for (i = 0; i < ML_CACHE_SIZE; ++i)
+	{
+		mc = &(buf->b_ml.ml_cache[i]);
+		if (mc->mc_bnum == 0 || mc->mc_high < lnum)
+			continue;
+		if (mc->mc_low <= lnum)
+			mc->mc_bnum = 0;
+		else
+		{
+			mc->mc_low += count;
+			mc->mc_high += count;
+		}
+	}
+}
+
 /*
  * make swap file name out of the filename
  */
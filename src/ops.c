@@ -1220,6 +1220,21 @@ doput(dir, count, fix_indent)
 					i = 1;
 				}
 
+				/*
+				 * Without fixing the indent the lines can be appended in one
+				 * go. The last line of MCHAR text was inserted above.
+				 */
+				if (!fix_indent && i < y_size)
+				{
+					j = y_size - i - (y_type == MCHAR);
+					if (j > 0 && ml_append_lines(lnum, y_array + i, NULL, j,
+															FALSE) == FAIL)
+						goto error;
+					lnum += y_size - i;
+					nr_lines += y_size - i;
+					i = y_size;
+				}
+
 				while (i < y_size)
 				{
 					if ((y_type != MCHAR || i < y_size - 1) &&
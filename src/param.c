@@ -129,6 +129,7 @@ static struct param params[] =
 		{"joinspaces", 	"js",	P_BOOL,				(char_u *)&p_js},
 		{"keywordprg",	"kp",  	P_STRING|P_EXPAND,	(char_u *)&p_kp},
 		{"laststatus",	"ls", 	P_NUM,				(char_u *)&p_ls},
+		{"lazyload",	"ll", 	P_NUM,				(char_u *)&p_ll},
 		{"lines",		NULL, 	P_NUM,				(char_u *)&Rows},
 		{"lisp",		NULL,	P_BOOL,				(char_u *)NULL},
 		{"list",		NULL,	P_BOOL|P_IND,		(char_u *)PV_LIST},
@@ -161,6 +162,7 @@ static struct param params[] =
 		{"ruler",		"ru",	P_BOOL,				(char_u *)&p_ru},
 		{"scroll",		NULL, 	P_NUM|P_IND,		(char_u *)PV_SCROLL},
 		{"scrolljump",	"sj", 	P_NUM,				(char_u *)&p_sj},
+		{"searchthreads", "sth", P_NUM,				(char_u *)&p_sth},
 		{"sections",	"sect",	P_STRING,			(char_u *)&p_sections},
 		{"secure",		NULL,	P_BOOL,				(char_u *)&p_secure},
 		{"shell",		"sh",	P_STRING|P_EXPAND,	(char_u *)&p_sh},
@@ -1890,6 +1892,10 @@ apply_autocmds(fname)
 	int				matched = FALSE;
 	int				temp;
 
+		/* the commands may need the whole file */
+	if (first_autopat != NULL)
+		readfile_finish();
+
 		/* Don't redraw while doing auto commands. */
 	temp = RedrawingDisabled;
 	RedrawingDisabled = TRUE;
@@ -1905,9 +1911,8 @@ apply_autocmds(fname)
 			def_ap = ap;
 			continue;
 		}
-		reg_ic = FALSE;		/* Don't ever ignore case */
-		reg_magic = TRUE;	/* Always use magic */
-		prog = regcomp(ap->reg_pat);
+		/* Always use magic, don't ever ignore case */
+		prog = regcomp_cached(ap->reg_pat, TRUE, FALSE);
 		if (prog != NULL && fname != NULL && regexec(prog, fname, TRUE))
 		{
 			for (ac = ap->cmds; ac != NULL; ac = ac->next)
@@ -92,6 +92,7 @@ EXTERN int	p_wi	INIT(= FALSE);		/* inversion of text is weird */
 EXTERN char_u *p_kp	INIT(= (char_u *)"man");	/* keyword program */
 EXTERN int	p_js	INIT(= TRUE);		/* use two spaces after period with Join */
 EXTERN long	p_ls	INIT(= 1);			/* last window has status line */
+EXTERN long	p_ll	INIT(= 1024);		/* Kbyte read before showing file */
 EXTERN int	p_magic INIT(= TRUE);		/* use some characters for reg exp */
 EXTERN char_u *p_mp	INIT(= (char_u *)"make");		/* program for :make command */
 EXTERN long p_mm	INIT(= MAXMEM);		/* maximal amount of memory for buffer */
@@ -123,6 +124,7 @@ EXTERN int	p_ru	INIT(= FALSE);		/* show column/line number */
 EXTERN int	p_ri	INIT(= FALSE);		/* reverse direction of insert */
 EXTERN int	p_secure	INIT(= FALSE);	/* do .exrc and .vimrc in secure mode */
 EXTERN long	p_sj	INIT(= 1);			/* scroll jump size */
+EXTERN long	p_sth	INIT(= 0);			/* number of threads for searching */
 EXTERN char_u *p_sections	INIT(= (char_u *)"SHNHH HUnhsh");		/* sections */
 #ifdef MSDOS
 EXTERN char_u *p_sh 	INIT(= (char_u *)"command");		/* name of shell to use */
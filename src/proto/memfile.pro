@@ -11,4 +11,5 @@ int mf_release_all __PARMS((void));
 blocknr_t mf_trans_del __PARMS((MEMFILE *mfp, blocknr_t old));
 void mf_fullname __PARMS((MEMFILE *mfp));
 int mf_need_trans __PARMS((MEMFILE *mfp));
+void mf_set_page_size __PARMS((MEMFILE *mfp, unsigned new_size));
 void mf_statistics __PARMS((void));
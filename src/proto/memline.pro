@@ -15,9 +15,14 @@ char_u *ml_get_cursor __PARMS((void));
 char_u *ml_get_buf __PARMS((BUF *buf, linenr_t lnum, int will_change));
 int ml_line_alloced __PARMS((void));
 int ml_append __PARMS((linenr_t lnum, char_u *line, colnr_t len, int newfile));
+int ml_append_lines __PARMS((linenr_t lnum, char_u **lines, colnr_t *lens, long count, int newfile));
 int ml_replace __PARMS((linenr_t lnum, char_u *line, int copy));
+int ml_replace_lines __PARMS((linenr_t lnum, char_u **lines, long count));
 int ml_delete __PARMS((linenr_t lnum, int message));
 void ml_setmarked __PARMS((linenr_t lnum));
 linenr_t ml_firstmarked __PARMS((void));
 int ml_has_mark __PARMS((linenr_t lnum));
+linenr_t ml_find_string __PARMS((linenr_t lnum, linenr_t last, int dir, char_u *str, int ic));
+int ml_copy_block __PARMS((linenr_t lnum, char_u **blockp, unsigned *sizep, linenr_t *lowp, linenr_t *highp));
+char_u *ml_block_line __PARMS((char_u *block, linenr_t low, linenr_t lnum));
 void ml_clearmarked __PARMS((void));
@@ -1,6 +1,15 @@
 /* regexp.c */
 char_u *skip_regexp __PARMS((char_u *p, int dirc));
-regexp *regcomp __PARMS((char_u *exp));
+regexp *regcomp __PARMS((char_u *exp, int magic, int ic));
+regexp *regcomp_cached __PARMS((char_u *exp, int magic, int ic));
+void regcache_statistics __PARMS((void));
 int regexec __PARMS((register regexp *prog, register char_u *string, int at_bol));
-int cstrncmp __PARMS((char_u *s1, char_u *s2, int n));
-char_u *cstrchr __PARMS((char_u *s, register int c));
+int regexec_state __PARMS((REGSTATE *rs, register regexp *prog, register char_u *string, int at_bol));
+int regexec_last __PARMS((register regexp *prog, register char_u *string, int at_bol, char_u *last));
+char_u *reg_must __PARMS((regexp *prog));
+regexp *regdup __PARMS((regexp *prog));
+REGSTATE *regstate_new __PARMS((regexp *prog));
+void regstate_free __PARMS((REGSTATE *rs));
+int cstrncmp __PARMS((char_u *s1, char_u *s2, int n, int ic));
+char_u *cstrchr __PARMS((char_u *s, register int c, int ic));
+char_u *cstrstr __PARMS((char_u *s, char_u *p, int ic));
@@ -1,6 +1,8 @@
 /* search.c */
 regexp *myregcomp __PARMS((char_u *pat, int sub_cmd, int which_pat));
 int searchit __PARMS((FPOS *pos, int dir, char_u *str, long count, int end, int message, int which_pat));
+int search_parallel __PARMS((regexp *prog, linenr_t lnum, linenr_t last, int dir, int type, linenr_t *resultp));
+int sub_parallel __PARMS((regexp *prog, char_u *sub, linenr_t lnum, linenr_t last, int global, long *nsubsp, linenr_t *nlinesp, linenr_t *lastp));
 int dosearch __PARMS((int dirc, char_u *str, int reverse, long count, int echo, int message));
 int search_for_exact_line __PARMS((FPOS *pos, int dir, char_u *pat));
 int searchc __PARMS((int c, register int dir, int type, long count));
@@ -15,16 +15,17 @@
 #include "proto.h"
 #include "param.h"
 
+static int	qf_parse_line __ARGS((int));
+static void qf_parse_end __ARGS((void));
+static int	qf_have __ARGS((int));
 static void qf_free __ARGS((void));
 static char_u *qf_types __ARGS((int, int));
 
 /*
- * for each error the next struct is allocated and linked in a list
+ * for each error the next struct is stored in the qf_lines[] array
  */
 struct qf_line
 {
-	struct qf_line	*qf_next;	/* pointer to next error in the list */
-	struct qf_line	*qf_prev;	/* pointer to previous error in the list */
 	linenr_t		 qf_lnum;	/* line number where the error occurred */
 	int				 qf_fnum;	/* file number for the line */
 	int				 qf_col;	/* column where the error occurred */
@@ -35,40 +36,69 @@ struct qf_line
 	char_u			 qf_valid;	/* valid error message detected */
 };
 
-static struct qf_line *qf_start;		/* pointer to the first error */
-static struct qf_line *qf_ptr;			/* pointer to the current error */
+static struct qf_line *qf_lines = NULL;	/* the errors, qf_lines[0] is first */
+static int	qf_size = 0;		/* number of entries allocated in qf_lines[] */
 
 static int	qf_count = 0;		/* number of errors (0 means no error list) */
 static int	qf_index;			/* current index in the error list */
 static int	qf_nonevalid;		/* set to TRUE if not a single valid entry found */
 
+#define QF_PTR	(&qf_lines[qf_index - 1])	/* the current error */
+
+/*
+ * The errorfile is parsed up to the first valid error by qf_init().  The rest
+ * is parsed when an error further on is wanted, or while waiting for the user
+ * to type a character.  This is the state for parsing the rest.
+ */
+static struct qf_parse
+{
+	FILE	*ps_fd;			/* errorfile, NULL when parsed completely */
+	char_u	*ps_fmtstr;		/* scanf() format, made from 'errorformat' */
+	char_u	*ps_namebuf;	/* file name from an error line */
+	char_u	*ps_errmsg;		/* message from an error line */
+#ifdef UTS2
+	char_u	*(ps_adr[7]);	/* where sscanf() stores the items */
+#else
+	void	*(ps_adr[7]);	/* where sscanf() stores the items */
+#endif
+	int		ps_adr_cnt;		/* number of used entries in ps_adr[] */
+	int		ps_col;			/* column from an error line */
+	int		ps_type;		/* error type from an error line */
+	long	ps_lnum;		/* line number from an error line */
+	int		ps_enr;			/* error number from an error line */
+	int		ps_error;		/* set to TRUE for a read error */
+} qf_ps;
+
+#define QF_MORE_LINES	50		/* lines parsed by one qf_more() call */
+
+/*
+ * Line changes made while the errorfile was not parsed completely.  They are
+ * applied to the errors that are parsed later.  When there are too many, the
+ * rest of the errorfile is parsed at once.
+ */
+#define QF_ADJUST_MAX	100
+
+static struct qf_adjust
+{
+	int			qa_fnum;		/* file number of the changed buffer */
+	linenr_t	qa_line1;		/* first changed line */
+	linenr_t	qa_line2;		/* last changed line */
+	long		qa_amount;		/* lines added, MAXLNUM for deleted */
+} qf_adjust[QF_ADJUST_MAX];
+static int	qf_adjust_count = 0;	/* number of used entries in qf_adjust[] */
+
 /*
- * Read the errorfile into memory, line by line, building the error list.
+ * Start reading the errorfile, building the error list.  The first valid
+ * error is jumped to, the rest of the file is parsed later.
  * Return FAIL for error, OK for success.
  */
 	int
 qf_init()
 {
-	char_u 			*namebuf;
-	char_u			*errmsg;
-	int				col;
-	int				type;
-	int				valid;
-	long			lnum;
-	int				enr;
 	FILE			*fd;
-	struct qf_line	*qfp = NULL;
-	struct qf_line	*qfprev = NULL;		/* init to make SASC shut up */
 	char_u			*pfmt, *fmtstr;
-#ifdef UTS2
-	char_u			*(adr[7]);
-#else
-	void			*(adr[7]);
-#endif
-	int				adr_cnt = 0;
 	int				maxlen;
 	int				i;
-	int				retval = FAIL;
 
 	if (p_ef == NULL || *p_ef == NUL)
 	{
@@ -76,21 +106,22 @@ qf_init()
 		return FAIL;
 	}
 
-	namebuf = alloc(CMDBUFFSIZE + 1);
-	errmsg = alloc(CMDBUFFSIZE + 1);
-	if (namebuf == NULL || errmsg == NULL)
-		goto qf_init_end;
-
 	if ((fd = fopen((char *)p_ef, "r")) == NULL)
 	{
 		emsg2(e_openerrf, p_ef);
-		goto qf_init_end;
+		return FAIL;
 	}
 	qf_free();
 	qf_index = 0;
+	qf_nonevalid = FALSE;
+	qf_ps.ps_fd = fd;
+	qf_ps.ps_adr_cnt = 0;
+	qf_ps.ps_error = FALSE;
 	for (i = 0; i < 7; ++i)
-		adr[i] = NULL;
+		qf_ps.ps_adr[i] = NULL;
 
+	qf_ps.ps_namebuf = alloc(CMDBUFFSIZE + 1);
+	qf_ps.ps_errmsg = alloc(CMDBUFFSIZE + 1);
 /*
  * The format string is copied and modified from p_efm to fmtstr.
  * Only a few % characters are allowed.
@@ -98,9 +129,9 @@ qf_init()
 		/* get some space to modify the format string into */
 		/* must be able to do the largest expansion 7 times (7 x 3) */
 	maxlen = STRLEN(p_efm) + 25;
-	fmtstr = alloc(maxlen);
-	if (fmtstr == NULL)
-		goto error2;
+	qf_ps.ps_fmtstr = fmtstr = alloc(maxlen);
+	if (qf_ps.ps_namebuf == NULL || qf_ps.ps_errmsg == NULL || fmtstr == NULL)
+		goto error;
 	for (pfmt = p_efm, i = 0; *pfmt; ++pfmt, ++i)
 	{
 		if (pfmt[0] != '%')				/* copy normal character */
@@ -111,11 +142,11 @@ qf_init()
 			switch (pfmt[1])
 			{
 			case 'f':		/* filename */
-					adr[adr_cnt++] = namebuf;
+					qf_ps.ps_adr[qf_ps.ps_adr_cnt++] = qf_ps.ps_namebuf;
 
 			case 'm':		/* message */
 					if (pfmt[1] == 'm')
-						adr[adr_cnt++] = errmsg;
+						qf_ps.ps_adr[qf_ps.ps_adr_cnt++] = qf_ps.ps_errmsg;
 					fmtstr[i++] = '[';
 					fmtstr[i++] = '^';
 					if (pfmt[2])
@@ -129,20 +160,20 @@ qf_init()
 					fmtstr[i] = ']';
 					break;
 			case 'c':		/* column */
-					adr[adr_cnt++] = &col;
+					qf_ps.ps_adr[qf_ps.ps_adr_cnt++] = &qf_ps.ps_col;
 					fmtstr[i] = 'd';
 					break;
 			case 'l':		/* line */
-					adr[adr_cnt++] = &lnum;
+					qf_ps.ps_adr[qf_ps.ps_adr_cnt++] = &qf_ps.ps_lnum;
 					fmtstr[i++] = 'l';
 					fmtstr[i] = 'd';
 					break;
 			case 'n':		/* error number */
-					adr[adr_cnt++] = &enr;
+					qf_ps.ps_adr[qf_ps.ps_adr_cnt++] = &qf_ps.ps_enr;
 					fmtstr[i] = 'd';
 					break;
 			case 't':		/* error type */
-					adr[adr_cnt++] = &type;
+					qf_ps.ps_adr[qf_ps.ps_adr_cnt++] = &qf_ps.ps_type;
 					fmtstr[i] = 'c';
 					break;
 			case '%':		/* %% */
@@ -151,110 +182,216 @@ qf_init()
 					break;
 			default:
 					EMSG("invalid % in format string");
-					goto error2;
+					goto error;
 			}
-			if (adr_cnt == 7)
+			if (qf_ps.ps_adr_cnt == 7)
 			{
 				EMSG("too many % in format string");
-				goto error2;
+				goto error;
 			}
 			++pfmt;
 		}
 		if (i >= maxlen - 6)
 		{
 			EMSG("invalid format string");
-			goto error2;
+			goto error;
 		}
 	}
 	fmtstr[i] = NUL;
 
-	while (fgets((char *)IObuff, CMDBUFFSIZE, fd) != NULL && !got_int)
+	/*
+	 * Parse the errorfile up to the first valid error.  When there is none
+	 * the whole file has been parsed.
+	 */
+	while (qf_index == 0 && qf_parse_line(FALSE) == OK)
+		;
+	if (!qf_ps.ps_error)
 	{
-		if ((qfp = (struct qf_line *)alloc((unsigned)sizeof(struct qf_line))) == NULL)
-			goto error2;
-
-		IObuff[CMDBUFFSIZE] = NUL;	/* for very long lines */
-		namebuf[0] = NUL;
-		errmsg[0] = NUL;
-		lnum = 0;
-		col = 0;
-		enr = -1;
-		type = 0;
-		valid = TRUE;
-
-		if (sscanf((char *)IObuff, (char *)fmtstr, adr[0], adr[1], adr[2], adr[3],
-												adr[4], adr[5]) != adr_cnt)
-		{
-			namebuf[0] = NUL;			/* something failed, remove file name */
-			valid = FALSE;
-			STRCPY(errmsg, IObuff);		/* copy whole line to error message */
-			if ((pfmt = STRRCHR(errmsg, '\n')) != NULL)
-				*pfmt = NUL;
-#ifdef MSDOS
-			if ((pfmt = STRRCHR(errmsg, '\r')) != NULL)
-				*pfmt = NUL;
-#endif
-		}
+		qf_jump(0, 0);			/* display first error */
+		return OK;
+	}
+error:
+	qf_free();
+	return FAIL;
+}
 
-		if (namebuf[0] == NUL)			/* no file name */
-			qfp->qf_fnum = 0;
-		else
-			qfp->qf_fnum = buflist_add(namebuf);
-		if ((qfp->qf_text = strsave(errmsg)) == NULL)
-			goto error1;
-		qfp->qf_lnum = lnum;
-		qfp->qf_col = col;
-		qfp->qf_nr = enr;
-		qfp->qf_type = type;
-		qfp->qf_valid = valid;
-
-		if (qf_count == 0)		/* first element in the list */
+/*
+ * Parse the next line of the errorfile and add it to the error list.
+ * When "idle" is TRUE we are waiting for a character: don't check for an
+ * interrupt, a typed CTRL-C is for the next command.
+ * Return FAIL when there is nothing more to parse or an error was found,
+ * OK otherwise.
+ */
+	static int
+qf_parse_line(idle)
+	int				idle;
+{
+	struct qf_line	*qfp;
+	struct qf_adjust *qa;
+	char_u			*p;
+	int				newsize;
+	int				i;
+
+	if (qf_ps.ps_fd == NULL)
+		return FAIL;
+	if (fgets((char *)IObuff, CMDBUFFSIZE, qf_ps.ps_fd) == NULL ||
+														(!idle && got_int))
+	{
+		if (ferror(qf_ps.ps_fd))
 		{
-			qf_start = qfp;
-			qfp->qf_prev = qfp;	/* first element points to itself */
+			emsg(e_readerrf);
+			qf_ps.ps_error = TRUE;
 		}
-		else
+		qf_parse_end();
+		return FAIL;
+	}
+
+	if (qf_count == qf_size)		/* qf_lines[] is full, make it bigger */
+	{
+		newsize = qf_size == 0 ? 100 : qf_size * 2;
+		qfp = (struct qf_line *)lalloc((long_u)newsize *
+											sizeof(struct qf_line), TRUE);
+		if (qfp == NULL)
 		{
-			qfp->qf_prev = qfprev;
-			qfprev->qf_next = qfp;
+			qf_ps.ps_error = TRUE;
+			qf_parse_end();
+			return FAIL;
 		}
-		qfp->qf_next = qfp;		/* last element points to itself */
-		qfp->qf_cleared = FALSE;
-		qfprev = qfp;
-		++qf_count;
-		if (qf_index == 0 && qfp->qf_valid)		/* first valid entry */
+		if (qf_lines != NULL)
 		{
-			qf_index = qf_count;
-			qf_ptr = qfp;
+			memmove((char *)qfp, (char *)qf_lines,
+								(size_t)qf_count * sizeof(struct qf_line));
+			free(qf_lines);
 		}
-		breakcheck();
+		qf_lines = qfp;
+		qf_size = newsize;
 	}
-	free(fmtstr);
-	if (!ferror(fd))
+	qfp = &qf_lines[qf_count];
+
+	IObuff[CMDBUFFSIZE] = NUL;	/* for very long lines */
+	qf_ps.ps_namebuf[0] = NUL;
+	qf_ps.ps_errmsg[0] = NUL;
+	qf_ps.ps_lnum = 0;
+	qf_ps.ps_col = 0;
+	qf_ps.ps_enr = -1;
+	qf_ps.ps_type = 0;
+	qfp->qf_valid = TRUE;
+
+	if (sscanf((char *)IObuff, (char *)qf_ps.ps_fmtstr, qf_ps.ps_adr[0],
+					qf_ps.ps_adr[1], qf_ps.ps_adr[2], qf_ps.ps_adr[3],
+					qf_ps.ps_adr[4], qf_ps.ps_adr[5]) != qf_ps.ps_adr_cnt)
 	{
-		if (qf_index == 0)		/* no valid entry found */
+		qf_ps.ps_namebuf[0] = NUL;	/* something failed, remove file name */
+		qfp->qf_valid = FALSE;
+		STRCPY(qf_ps.ps_errmsg, IObuff);	/* copy whole line to message */
+		if ((p = STRRCHR(qf_ps.ps_errmsg, '\n')) != NULL)
+			*p = NUL;
+#ifdef MSDOS
+		if ((p = STRRCHR(qf_ps.ps_errmsg, '\r')) != NULL)
+			*p = NUL;
+#endif
+	}
+
+	if ((qfp->qf_text = strsave(qf_ps.ps_errmsg)) == NULL)
+	{
+		qf_ps.ps_error = TRUE;
+		qf_parse_end();
+		return FAIL;
+	}
+	if (qf_ps.ps_namebuf[0] == NUL)		/* no file name */
+		qfp->qf_fnum = 0;
+	else
+		qfp->qf_fnum = buflist_add(qf_ps.ps_namebuf);
+	qfp->qf_lnum = qf_ps.ps_lnum;
+	qfp->qf_col = qf_ps.ps_col;
+	qfp->qf_nr = qf_ps.ps_enr;
+	qfp->qf_type = qf_ps.ps_type;
+	qfp->qf_cleared = FALSE;
+	for (qa = qf_adjust, i = qf_adjust_count; --i >= 0; ++qa)
+		if (qfp->qf_fnum == qa->qa_fnum &&
+				qfp->qf_lnum >= qa->qa_line1 && qfp->qf_lnum <= qa->qa_line2)
 		{
-			qf_ptr = qf_start;
-			qf_index = 1;
-			qf_nonevalid = TRUE;
+			if (qa->qa_amount == MAXLNUM)
+				qfp->qf_cleared = TRUE;
+			else
+				qfp->qf_lnum += qa->qa_amount;
 		}
-		else
-			qf_nonevalid = FALSE;
-		qf_jump(0, 0);			/* display first error */
-		retval = OK;
-		goto qf_init_ok;
+	++qf_count;
+	if (qf_index == 0 && qfp->qf_valid)		/* first valid entry */
+		qf_index = qf_count;
+	if (!idle)
+		breakcheck();
+	return OK;
+}
+
+/*
+ * The errorfile has been parsed completely, or parsing stopped: close it and
+ * free the parse state.
+ */
+	static void
+qf_parse_end()
+{
+	if (qf_ps.ps_fd == NULL)
+		return;
+	fclose(qf_ps.ps_fd);
+	qf_ps.ps_fd = NULL;
+	qf_adjust_count = 0;
+	free(qf_ps.ps_fmtstr);
+	free(qf_ps.ps_namebuf);
+	free(qf_ps.ps_errmsg);
+	if (qf_index == 0 && qf_count > 0)		/* no valid entry found */
+	{
+		qf_index = 1;
+		qf_nonevalid = TRUE;
 	}
-	emsg(e_readerrf);
-error1:
-	free(qfp);
-error2:
-	qf_free();
-qf_init_ok:
-	fclose(fd);
-qf_init_end:
-	free(namebuf);
-	free(errmsg);
-	return retval;
+}
+
+/*
+ * Return TRUE when error number "nr" is in the list, parsing the errorfile
+ * further when needed.
+ */
+	static int
+qf_have(nr)
+	int		nr;
+{
+	while (qf_count < nr && qf_parse_line(FALSE) == OK)
+		;
+	return (qf_count >= nr);
+}
+
+/*
+ * Return TRUE when the errorfile has not been parsed completely yet.
+ */
+	int
+qf_pending()
+{
+	return (qf_ps.ps_fd != NULL);
+}
+
+/*
+ * Parse the next part of the errorfile.  Called while waiting for the user to
+ * type a character, not at the --more-- prompt of qf_list().  Stops only when
+ * the end of the file is reached, an interrupt doesn't end the list here.
+ */
+	void
+qf_more()
+{
+	int		i;
+
+	for (i = 0; i < QF_MORE_LINES; ++i)
+		if (qf_parse_line(TRUE) == FAIL)
+			break;
+}
+
+/*
+ * Parse the rest of the errorfile.  Must be called before doing something
+ * that needs all the errors.
+ */
+	void
+qf_finish()
+{
+	while (qf_parse_line(FALSE) == OK)
+		;
 }
 
 /*
@@ -269,7 +406,7 @@ qf_jump(dir, errornr)
 	int		dir;
 	int		errornr;
 {
-	struct qf_line	*old_qf_ptr;
+	struct qf_line	*qfp;
 	int				old_qf_index;
 	static char_u	*e_no_more_errors = (char_u *)"No more errors";
 	char_u			*err = e_no_more_errors;
@@ -281,19 +418,16 @@ qf_jump(dir, errornr)
 		return;
 	}
 
-	old_qf_ptr = qf_ptr;
 	old_qf_index = qf_index;
 	if (dir == FORWARD)		/* next valid entry */
 	{
 		while (errornr--)
 		{
-			old_qf_ptr = qf_ptr;
 			old_qf_index = qf_index;
 			do
 			{
-				if (qf_index == qf_count || qf_ptr->qf_next == NULL)
+				if (!qf_have(qf_index + 1))
 				{
-					qf_ptr = old_qf_ptr;
 					qf_index = old_qf_index;
 					if (err != NULL)
 					{
@@ -304,8 +438,7 @@ qf_jump(dir, errornr)
 					break;
 				}
 				++qf_index;
-				qf_ptr = qf_ptr->qf_next;
-			} while (!qf_nonevalid && !qf_ptr->qf_valid);
+			} while (!qf_nonevalid && !QF_PTR->qf_valid);
 			err = NULL;
 		}
 	}
@@ -313,13 +446,11 @@ qf_jump(dir, errornr)
 	{
 		while (errornr--)
 		{
-			old_qf_ptr = qf_ptr;
 			old_qf_index = qf_index;
 			do
 			{
-				if (qf_index == 1 || qf_ptr->qf_prev == NULL)
+				if (qf_index == 1)
 				{
-					qf_ptr = old_qf_ptr;
 					qf_index = old_qf_index;
 					if (err != NULL)
 					{
@@ -330,65 +461,60 @@ qf_jump(dir, errornr)
 					break;
 				}
 				--qf_index;
-				qf_ptr = qf_ptr->qf_prev;
-			} while (!qf_nonevalid && !qf_ptr->qf_valid);
+			} while (!qf_nonevalid && !QF_PTR->qf_valid);
 			err = NULL;
 		}
 	}
 	else if (errornr != 0)		/* go to specified number */
 	{
-		while (errornr < qf_index && qf_index > 1 && qf_ptr->qf_prev != NULL)
-		{
-			--qf_index;
-			qf_ptr = qf_ptr->qf_prev;
-		}
-		while (errornr > qf_index && qf_index < qf_count && qf_ptr->qf_next != NULL)
-		{
-			++qf_index;
-			qf_ptr = qf_ptr->qf_next;
-		}
+		if (qf_have(errornr))
+			qf_index = errornr;
+		else
+			qf_index = qf_count;
 	}
 
 	/*
 	 * If there is a file name, 
 	 * read the wanted file if needed, and check autowrite etc.
 	 */
-	if (qf_ptr->qf_fnum == 0 || buflist_getfile(qf_ptr->qf_fnum, (linenr_t)1, TRUE) == OK)
+	qfp = QF_PTR;
+	if (qfp->qf_fnum == 0 || buflist_getfile(qfp->qf_fnum, (linenr_t)1, TRUE) == OK)
 	{
 		/*
 		 * Go to line with error, unless qf_lnum is 0.
 		 */
-		i = qf_ptr->qf_lnum;
+		qfp = QF_PTR;		/* qf_lines[] may have moved at a prompt */
+		i = qfp->qf_lnum;
 		if (i > 0)
 		{
 			if (i > curbuf->b_ml.ml_line_count)
 				i = curbuf->b_ml.ml_line_count;
 			curwin->w_cursor.lnum = i;
 		}
-		if (qf_ptr->qf_col > 0)
+		if (qfp->qf_col > 0)
 		{
-			curwin->w_cursor.col = qf_ptr->qf_col;
+			curwin->w_cursor.col = qfp->qf_col;
 			adjust_cursor();
 		}
 		else
 			beginline(TRUE);
 		cursupdate();
-		smsg((char_u *)"(%d of %d)%s%s: %s", qf_index, qf_count, 
-					qf_ptr->qf_cleared ? (char_u *)" (line deleted)" : (char_u *)"",
-					qf_types(qf_ptr->qf_type, qf_ptr->qf_nr), qf_ptr->qf_text);
+		smsg((char_u *)"(%d of %d%s)%s%s: %s", qf_index, qf_count,
+					qf_pending() ? (char_u *)"+" : (char_u *)"",
+					qfp->qf_cleared ? (char_u *)" (line deleted)" : (char_u *)"",
+					qf_types(qfp->qf_type, qfp->qf_nr), qfp->qf_text);
 		/*
 		 * if the message is short, redisplay after redrawing the screen
 		 */
 		if (linetabsize(IObuff) < (Rows - cmdline_row - 1) * Columns + sc_col)
 			keep_msg = IObuff;
 	}
-	else if (qf_ptr->qf_fnum != 0)
+	else if (qfp->qf_fnum != 0)
 	{
 		/*
 		 * Couldn't open file, so put index back where it was.  This could
 		 * happen if the file was readonly and we changed something - webb
 		 */
-		qf_ptr = old_qf_ptr;
 		qf_index = old_qf_index;
   	}
 }
@@ -413,10 +539,10 @@ qf_list(all)
 
 	if (qf_nonevalid)
 		all = TRUE;
-	qfp = qf_start;
 	set_highlight('d');		/* Same as for directories */
-	for (i = 1; !got_int && i <= qf_count; ++i)
+	for (i = 1; !got_int && qf_have(i); ++i)
 	{
+		qfp = &qf_lines[i - 1];
 		if (qfp->qf_valid || all)
 		{
 			msg_outchar('\n');
@@ -442,7 +568,6 @@ qf_list(all)
 			msg_prt_line(qfp->qf_text);
 			flushbuf();					/* show one line at a time */
 		}
-		qfp = qfp->qf_next;
 		breakcheck();
 	}
 }
@@ -453,16 +578,12 @@ qf_list(all)
 	static void
 qf_free()
 {
-	struct qf_line *qfp;
-
+	qf_parse_end();
 	while (qf_count)
-	{
-		qfp = qf_start->qf_next;
-		free(qf_start->qf_text);
-		free(qf_start);
-		qf_start = qfp;
-		--qf_count;
-	}
+		free(qf_lines[--qf_count].qf_text);
+	free(qf_lines);
+	qf_lines = NULL;
+	qf_size = 0;
 }
 
 /*
@@ -476,17 +597,27 @@ qf_mark_adjust(line1, line2, amount)
 {
 	register int i;
 	struct qf_line *qfp;
+	struct qf_adjust *qa;
 
-	if (qf_count)
-		for (i = 0, qfp = qf_start; i < qf_count; ++i, qfp = qfp->qf_next)
-			if (qfp->qf_fnum == curbuf->b_fnum &&
-							qfp->qf_lnum >= line1 && qfp->qf_lnum <= line2)
-			{
-				if (amount == MAXLNUM)
-					qfp->qf_cleared = TRUE;
-				else
-					qfp->qf_lnum += amount;
-			}
+	if (qf_pending() && qf_adjust_count == QF_ADJUST_MAX)
+		qf_finish();		/* too many changes to remember */
+	for (i = 0, qfp = qf_lines; i < qf_count; ++i, ++qfp)
+		if (qfp->qf_fnum == curbuf->b_fnum &&
+						qfp->qf_lnum >= line1 && qfp->qf_lnum <= line2)
+		{
+			if (amount == MAXLNUM)
+				qfp->qf_cleared = TRUE;
+			else
+				qfp->qf_lnum += amount;
+		}
+	if (qf_pending())		/* remember for errors parsed later */
+	{
+		qa = &qf_adjust[qf_adjust_count++];
+		qa->qa_fnum = curbuf->b_fnum;
+		qa->qa_line1 = line1;
+		qa->qa_line2 = line2;
+		qa->qa_amount = amount;
+	}
 }
 
 /*
@@ -36,8 +36,9 @@
  *
  * $Log:		regexp.c,v $
  * Revision 1.2  88/04/28  08:09:45  tony
- * First modification of the regexp library. Added an external variable
- * 'reg_ic' which can be set to indicate that case should be ignored.
+ * First modification of the regexp library. Added a way to indicate that
+ * case should be ignored: the 'ic' argument of regcomp(), which is stored
+ * in the compiled program (regic).
  * Added a new parameter to regexec() to indicate that the given string
  * comes from the beginning of a line and is thus eligible to match
  * 'beginning-of-line'.
@@ -66,18 +67,26 @@
  * simple cases.  They are:
  *
  * regstart 	char that must begin a match; '\0' if none obvious
+ * regprefix	string (pointer into program) that must begin a match, or NULL
  * reganch		is the match anchored (at beginning-of-line only)?
  * regmust		string (pointer into program) that match must include, or NULL
  * regmlen		length of regmust string
+ * regnstate	number of NFA states, 0 when the backtracking matcher is used
+ * regplen		length of the program
+ * regnsub		number of subexpressions, plus one for the whole match
  *
  * Regstart and reganch permit very fast decisions on suitable starting points
- * for a match, cutting down the work a lot.  Regmust permits fast rejection
- * of lines that cannot possibly match.  The regmust tests are costly enough
- * that regcomp() supplies a regmust only if the r.e. contains something
- * potentially expensive (at present, the only such thing detected is * or +
- * at the start of the r.e., which can involve a lot of backup).  Regmlen is
- * supplied because the test in regexec() needs it and regcomp() is computing
- * it anyway.
+ * for a match, cutting down the work a lot.  Regprefix is set when the
+ * r.e. starts with more than one literal character, cstrstr() finds the
+ * possible starting points even faster.  Regmust permits fast rejection
+ * of lines that cannot possibly match.  Regcomp() supplies a regmust if the
+ * r.e. contains something potentially expensive (* or + at the start of the
+ * r.e., which can involve a lot of backup) or when there is a literal string
+ * after the start, cstrstr() is cheap compared to trying a match at every
+ * character.  Regmlen is supplied because regcomp() is computing it anyway.
+ *
+ * Regnstate, regplen and regnsub are used to run the program as an NFA, see
+ * nfa_exec().
  */
 
 /*
@@ -207,21 +216,25 @@ char_u		   *reg_prev_sub;
 #endif
 
 /*
- * This if for vi's "magic" mode. If magic is false, only ^$\ are magic.
- */
-
-int				reg_magic = 1;
-
-/*
- * Global work variables for regcomp().
+ * Work variables for regcomp().  They are kept in an RCSTATE on the stack of
+ * regcomp(), nothing is left behind in global variables.
  */
-
-static char_u    *regparse;	/* Input-scan pointer. */
-static int		regnpar;		/* () count. */
-static char_u 	regdummy;
-static char_u   *regcode;		/* Code-emit pointer; &regdummy = don't. */
-static long 	regsize;		/* Code size. */
-static char_u   **regendp;		/* Ditto for endp. */
+typedef struct rcstate
+{
+	char_u		*rc_parse;		/* Input-scan pointer. */
+	int			rc_npar;		/* () count. */
+	char_u		*rc_code;		/* Code-emit pointer; &regdummy = don't. */
+	long		rc_size;		/* Code size. */
+	char_u		**rc_endp;		/* Ditto for endp. */
+	int			rc_magic;		/* vi's "magic" mode, if FALSE only ^$\ are
+								   magic */
+	int			rc_curchr;		/* lexical analyzer, see getchr() */
+	int			rc_prevchr;
+	int			rc_nextchr;		/* used for ungetchr() */
+	int			rc_at_start;	/* True when we are on the first character */
+} RCSTATE;
+
+static char_u 	regdummy;		/* only the address is used */
 
 /*
  * META contains all characters that may be magic, except '^' and '$'.
@@ -246,24 +259,24 @@ static char_u   **regendp;		/* Ditto for endp. */
 /*
  * Forward declarations for regcomp()'s friends.
  */
-static void		initchr __ARGS((char_u *));
-static int		getchr __ARGS((void));
-static int		peekchr __ARGS((void));
-#define PeekChr() curchr	/* shortcut only when last action was peekchr() */
-static int 		curchr;
-static void		skipchr __ARGS((void));
-static void		ungetchr __ARGS((void));
-static char_u    *reg __ARGS((int, int *));
-static char_u    *regbranch __ARGS((int *));
-static char_u    *regpiece __ARGS((int *));
-static char_u    *regatom __ARGS((int *));
-static char_u    *regnode __ARGS((int));
+static void		initchr __ARGS((RCSTATE *, char_u *));
+static int		getchr __ARGS((RCSTATE *));
+static int		peekchr __ARGS((RCSTATE *));
+#define PeekChr() rc->rc_curchr	/* shortcut only when last action was peekchr() */
+static void		skipchr __ARGS((RCSTATE *));
+static void		ungetchr __ARGS((RCSTATE *));
+static char_u    *reg __ARGS((RCSTATE *, int, int *));
+static char_u    *regbranch __ARGS((RCSTATE *, int *));
+static char_u    *regpiece __ARGS((RCSTATE *, int *));
+static char_u    *regatom __ARGS((RCSTATE *, int *));
+static char_u    *regnode __ARGS((RCSTATE *, int));
 static char_u    *regnext __ARGS((char_u *));
-static void 	regc __ARGS((int));
-static void 	unregc __ARGS((void));
-static void 	reginsert __ARGS((int, char_u *));
+static void 	regc __ARGS((RCSTATE *, int));
+static void 	unregc __ARGS((RCSTATE *));
+static void 	reginsert __ARGS((RCSTATE *, int, char_u *));
 static void 	regtail __ARGS((char_u *, char_u *));
 static void 	regoptail __ARGS((char_u *, char_u *));
+static int		nfa_count_states __ARGS((regexp *));
 
 #undef STRCSPN
 #ifdef STRCSPN
@@ -320,16 +333,25 @@ skip_regexp(p, dirc)
  *
  * Beware that the optimization-preparation code in here knows about some
  * of the structure of the compiled regexp.
+ *
+ * 'magic' is vi's "magic" mode, when FALSE only ^$\ are magic.  When 'ic' is
+ * TRUE regexec() ignores case for this regexp.  No global variables are
+ * used, except reg_prev_sub for "~".
  */
 	regexp		   *
-regcomp(exp)
+regcomp(exp, magic, ic)
 	char_u		   *exp;
+	int				magic;
+	int				ic;
 {
+	RCSTATE			rcstate;
+	register RCSTATE *rc = &rcstate;
 	register regexp *r;
 	register char_u  *scan;
 	register char_u  *longest;
 	register int	len;
 	int 			flags;
+	char_u			*first;
 /*	extern char    *malloc();*/
 
 	if (exp == NULL)
@@ -345,23 +367,25 @@ regcomp(exp)
 	}
 #endif
 
+	rc->rc_magic = magic;
+
 	/* First pass: determine size, legality. */
-	initchr((char_u *)exp);
-	regnpar = 1;
-	regsize = 0L;
-	regcode = &regdummy;
-	regendp = NULL;
-	regc(MAGIC);
-	if (reg(0, &flags) == NULL)
+	initchr(rc, (char_u *)exp);
+	rc->rc_npar = 1;
+	rc->rc_size = 0L;
+	rc->rc_code = &regdummy;
+	rc->rc_endp = NULL;
+	regc(rc, MAGIC);
+	if (reg(rc, 0, &flags) == NULL)
 		return NULL;
 
 	/* Small enough for pointer-storage convention? */
-	if (regsize >= 32767L)		/* Probably could be 65535L. */
+	if (rc->rc_size >= 32767L)		/* Probably could be 65535L. */
 		EMSG_RETURN(e_toolong);
 
 	/* Allocate space. */
-/*	r = (regexp *) malloc((unsigned) (sizeof(regexp) + regsize));*/
-	r = (regexp *) alloc((unsigned) (sizeof(regexp) + regsize));
+/*	r = (regexp *) malloc((unsigned) (sizeof(regexp) + rc->rc_size));*/
+	r = (regexp *) alloc((unsigned) (sizeof(regexp) + rc->rc_size));
 	if (r == NULL)
 		return NULL;
 
@@ -374,12 +398,12 @@ regcomp(exp)
 #endif
 
 	/* Second pass: emit code. */
-	initchr((char_u *)exp);
-	regnpar = 1;
-	regcode = r->program;
-	regendp = r->endp;
-	regc(MAGIC);
-	if (reg(0, &flags) == NULL) {
+	initchr(rc, (char_u *)exp);
+	rc->rc_npar = 1;
+	rc->rc_code = r->program;
+	rc->rc_endp = r->endp;
+	regc(rc, MAGIC);
+	if (reg(rc, 0, &flags) == NULL) {
 		free(r);
 		return NULL;
 	}
@@ -389,14 +413,22 @@ regcomp(exp)
 	r->reganch = 0;
 	r->regmust = NULL;
 	r->regmlen = 0;
+	r->regprefix = NULL;
+	r->regplen = (int)(rc->rc_code - r->program);
+	r->regnsub = rc->rc_npar;
+	r->regic = ic;
+	r->regnstate = nfa_count_states(r);
 	scan = r->program + 1;		/* First BRANCH. */
 	if (OP(regnext(scan)) == END) { 	/* Only one top-level choice. */
 		scan = OPERAND(scan);
+		first = scan;
 
 		/* Starting-point info. */
-		if (OP(scan) == EXACTLY)
+		if (OP(scan) == EXACTLY) {
 			r->regstart = *OPERAND(scan);
-		else if (OP(scan) == BOL)
+			if (STRLEN(OPERAND(scan)) > 1)
+				r->regprefix = OPERAND(scan);
+		} else if (OP(scan) == BOL)
 			r->reganch++;
 
 		/*
@@ -411,14 +443,20 @@ regcomp(exp)
 		 * When the r.e. starts with BOW, it is faster to look for a regmust
 		 * first. Used a lot for "#" and "*" commands. (Added by mool).
 		 */
-		if (flags & SPSTART || OP(scan) == BOW) {
-			longest = NULL;
-			len = 0;
-			for (; scan != NULL; scan = regnext(scan))
-				if (OP(scan) == EXACTLY && STRLEN(OPERAND(scan)) >= (size_t)len) {
-					longest = OPERAND(scan);
-					len = STRLEN(OPERAND(scan));
-				}
+		/*
+		 * A literal string that is not at the start is also used, finding
+		 * it with cstrstr() is fast.  At the start it's found with
+		 * regstart or regprefix already.
+		 */
+		longest = NULL;
+		len = 0;
+		for (; scan != NULL; scan = regnext(scan))
+			if (OP(scan) == EXACTLY && STRLEN(OPERAND(scan)) >= (size_t)len) {
+				longest = OPERAND(scan);
+				len = STRLEN(OPERAND(scan));
+			}
+		if (flags & SPSTART || OP(first) == BOW ||
+							(len > 0 && longest != OPERAND(first))) {
 			r->regmust = longest;
 			r->regmlen = len;
 		}
@@ -429,6 +467,106 @@ regcomp(exp)
 	return r;
 }
 
+/*
+ * Cache of compiled regexps, used by regcomp_cached().  The most recently used
+ * entry is first in the list.
+ */
+#define REGCACHE_SIZE	16		/* maximum number of entries */
+
+typedef struct regcache REGCACHE;
+struct regcache
+{
+	REGCACHE	*rx_next;		/* next entry, less recently used */
+	char_u		*rx_pat;		/* the pattern */
+	int			rx_magic;		/* 'magic' argument of regcomp() */
+	int			rx_ic;			/* 'ic' argument of regcomp() */
+	regexp		*rx_prog;		/* the compiled pattern */
+};
+
+static REGCACHE	*regcache = NULL;
+static int		regcache_count = 0;		/* number of entries */
+static long		regcache_hit = 0;		/* found in the cache */
+static long		regcache_miss = 0;		/* compiled */
+
+/*
+ - regcomp_cached - compile a regular expression, using the cache
+ *
+ * Like regcomp(), but when the same pattern was compiled recently with the
+ * same 'magic' and 'ic' a copy of that regexp is returned.  The caller must
+ * free() it.  Patterns with a '~' are not cached, they depend on the
+ * previous substitute string.
+ */
+	regexp *
+regcomp_cached(exp, magic, ic)
+	char_u		   *exp;
+	int				magic;
+	int				ic;
+{
+	REGCACHE	  **pp;
+	REGCACHE	   *rx;
+	regexp		   *r;
+
+	if (exp == NULL || STRCHR(exp, '~') != NULL)
+		return regcomp(exp, magic, ic);
+	magic = (magic != 0);
+	ic = (ic != 0);
+
+	for (pp = &regcache; (rx = *pp) != NULL; pp = &rx->rx_next)
+		if (rx->rx_magic == magic && rx->rx_ic == ic &&
+											STRCMP(rx->rx_pat, exp) == 0) {
+			++regcache_hit;
+			*pp = rx->rx_next;			/* move it to the front */
+			rx->rx_next = regcache;
+			regcache = rx;
+			return regdup(rx->rx_prog);
+		}
+
+	++regcache_miss;
+	r = regcomp(exp, magic, ic);
+	if (r == NULL)
+		return NULL;
+
+	if (regcache_count >= REGCACHE_SIZE) {
+		/* Cache is full: reuse the least recently used entry. */
+		for (pp = &regcache; (*pp)->rx_next != NULL; pp = &(*pp)->rx_next)
+			;
+		rx = *pp;
+		*pp = NULL;
+		free(rx->rx_pat);
+		free(rx->rx_prog);
+	} else {
+		rx = (REGCACHE *)alloc((unsigned)sizeof(REGCACHE));
+		if (rx == NULL)
+			return r;
+		++regcache_count;
+	}
+	rx->rx_pat = strsave(exp);
+	rx->rx_prog = regdup(r);
+	if (rx->rx_pat == NULL || rx->rx_prog == NULL) {
+		free(rx->rx_pat);
+		free(rx->rx_prog);
+		free(rx);
+		--regcache_count;
+		return r;
+	}
+	rx->rx_magic = magic;
+	rx->rx_ic = ic;
+	rx->rx_next = regcache;
+	regcache = rx;
+	return r;
+}
+
+/*
+ - regcache_statistics - show how well the regexp cache works, for ":regstat"
+ */
+	void
+regcache_statistics()
+{
+	sprintf((char *)IObuff, "%d cached regexps, %ld hit, %ld miss",
+							regcache_count, regcache_hit, regcache_miss);
+	msg(IObuff);
+}
+
 /*
  - reg - regular expression, i.e. main body or parenthesized thing
  *
@@ -439,7 +577,8 @@ regcomp(exp)
  * follows makes it hard to avoid.
  */
 	static char_u *
-reg(paren, flagp)
+reg(rc, paren, flagp)
+	RCSTATE		   *rc;
 	int 			paren;		/* Parenthesized? */
 	int 		   *flagp;
 {
@@ -453,18 +592,18 @@ reg(paren, flagp)
 
 	/* Make an MOPEN node, if parenthesized. */
 	if (paren) {
-		if (regnpar >= NSUBEXP)
+		if (rc->rc_npar >= NSUBEXP)
 			EMSG_RETURN(e_toombra);
-		parno = regnpar;
-		regnpar++;
-		ret = regnode(MOPEN + parno);
-		if (regendp)
-			regendp[parno] = NULL;	/* haven't seen the close paren yet */
+		parno = rc->rc_npar;
+		rc->rc_npar++;
+		ret = regnode(rc, MOPEN + parno);
+		if (rc->rc_endp)
+			rc->rc_endp[parno] = NULL;	/* haven't seen the close paren yet */
 	} else
 		ret = NULL;
 
 	/* Pick up the branches, linking them together. */
-	br = regbranch(&flags);
+	br = regbranch(rc, &flags);
 	if (br == NULL)
 		return NULL;
 	if (ret != NULL)
@@ -474,9 +613,9 @@ reg(paren, flagp)
 	if (!(flags & HASWIDTH))
 		*flagp &= ~HASWIDTH;
 	*flagp |= flags & SPSTART;
-	while (peekchr() == Magic('|')) {
-		skipchr();
-		br = regbranch(&flags);
+	while (peekchr(rc) == Magic('|')) {
+		skipchr(rc);
+		br = regbranch(rc, &flags);
 		if (br == NULL)
 			return NULL;
 		regtail(ret, br);		/* BRANCH -> BRANCH. */
@@ -486,7 +625,7 @@ reg(paren, flagp)
 	}
 
 	/* Make a closing node, and hook it on the end. */
-	ender = regnode((paren) ? MCLOSE + parno : END);
+	ender = regnode(rc, (paren) ? MCLOSE + parno : END);
 	regtail(ret, ender);
 
 	/* Hook the tails of the branches to the closing node. */
@@ -494,9 +633,9 @@ reg(paren, flagp)
 		regoptail(br, ender);
 
 	/* Check for proper termination. */
-	if (paren && getchr() != Magic(')'))
+	if (paren && getchr(rc) != Magic(')'))
 		EMSG_RETURN(e_toombra)
-	else if (!paren && peekchr() != '\0')
+	else if (!paren && peekchr(rc) != '\0')
 	{
 		if (PeekChr() == Magic(')'))
 			EMSG_RETURN(e_toomket)
@@ -508,8 +647,8 @@ reg(paren, flagp)
 	 * Here we set the flag allowing back references to this set of
 	 * parentheses.
 	 */
-	if (paren && regendp)
-		regendp[parno] = ender;	/* have seen the close paren */
+	if (paren && rc->rc_endp)
+		rc->rc_endp[parno] = ender;	/* have seen the close paren */
 	return ret;
 }
 
@@ -519,7 +658,8 @@ reg(paren, flagp)
  * Implements the concatenation operator.
  */
 	static char_u    *
-regbranch(flagp)
+regbranch(rc, flagp)
+	RCSTATE		   *rc;
 	int 		   *flagp;
 {
 	register char_u  *ret;
@@ -529,10 +669,10 @@ regbranch(flagp)
 
 	*flagp = WORST; 			/* Tentatively. */
 
-	ret = regnode(BRANCH);
+	ret = regnode(rc, BRANCH);
 	chain = NULL;
-	while (peekchr() != '\0' && PeekChr() != Magic('|') && PeekChr() != Magic(')')) {
-		latest = regpiece(&flags);
+	while (peekchr(rc) != '\0' && PeekChr() != Magic('|') && PeekChr() != Magic(')')) {
+		latest = regpiece(rc, &flags);
 		if (latest == NULL)
 			return NULL;
 		*flagp |= flags & HASWIDTH;
@@ -543,7 +683,7 @@ regbranch(flagp)
 		chain = latest;
 	}
 	if (chain == NULL)			/* Loop ran zero times. */
-		(void) regnode(NOTHING);
+		(void) regnode(rc, NOTHING);
 
 	return ret;
 }
@@ -558,7 +698,8 @@ regbranch(flagp)
  * endmarker role is not redundant.
  */
 static char_u    *
-regpiece(flagp)
+regpiece(rc, flagp)
+	RCSTATE		   *rc;
 	int 		   *flagp;
 {
 	register char_u  *ret;
@@ -566,11 +707,11 @@ regpiece(flagp)
 	register char_u  *next;
 	int 			flags;
 
-	ret = regatom(&flags);
+	ret = regatom(rc, &flags);
 	if (ret == NULL)
 		return NULL;
 
-	op = peekchr();
+	op = peekchr(rc);
 	if (!ismult(op)) {
 		*flagp = flags;
 		return ret;
@@ -580,33 +721,33 @@ regpiece(flagp)
 	*flagp = (op != Magic('+')) ? (WORST | SPSTART) : (WORST | HASWIDTH);
 
 	if (op == Magic('*') && (flags & SIMPLE))
-		reginsert(STAR, ret);
+		reginsert(rc, STAR, ret);
 	else if (op == Magic('*')) {
 		/* Emit x* as (x&|), where & means "self". */
-		reginsert(BRANCH, ret); /* Either x */
-		regoptail(ret, regnode(BACK));	/* and loop */
+		reginsert(rc, BRANCH, ret); /* Either x */
+		regoptail(ret, regnode(rc, BACK));	/* and loop */
 		regoptail(ret, ret);	/* back */
-		regtail(ret, regnode(BRANCH));	/* or */
-		regtail(ret, regnode(NOTHING)); /* null. */
+		regtail(ret, regnode(rc, BRANCH));	/* or */
+		regtail(ret, regnode(rc, NOTHING)); /* null. */
 	} else if (op == Magic('+') && (flags & SIMPLE))
-		reginsert(PLUS, ret);
+		reginsert(rc, PLUS, ret);
 	else if (op == Magic('+')) {
 		/* Emit x+ as x(&|), where & means "self". */
-		next = regnode(BRANCH); /* Either */
+		next = regnode(rc, BRANCH); /* Either */
 		regtail(ret, next);
-		regtail(regnode(BACK), ret);	/* loop back */
-		regtail(next, regnode(BRANCH)); /* or */
-		regtail(ret, regnode(NOTHING)); /* null. */
+		regtail(regnode(rc, BACK), ret);	/* loop back */
+		regtail(next, regnode(rc, BRANCH)); /* or */
+		regtail(ret, regnode(rc, NOTHING)); /* null. */
 	} else if (op == Magic('=')) {
 		/* Emit x= as (x|) */
-		reginsert(BRANCH, ret); /* Either x */
-		regtail(ret, regnode(BRANCH));	/* or */
-		next = regnode(NOTHING);/* null. */
+		reginsert(rc, BRANCH, ret); /* Either x */
+		regtail(ret, regnode(rc, BRANCH));	/* or */
+		next = regnode(rc, NOTHING);/* null. */
 		regtail(ret, next);
 		regoptail(ret, next);
 	}
-	skipchr();
-	if (ismult(peekchr()))
+	skipchr(rc);
+	if (ismult(peekchr(rc)))
 		EMSG_RETURN((char_u *)"Nested *=+");
 
 	return ret;
@@ -620,7 +761,8 @@ regpiece(flagp)
  * faster to run.
  */
 static char_u    *
-regatom(flagp)
+regatom(rc, flagp)
+	RCSTATE		   *rc;
 	int 		   *flagp;
 {
 	register char_u  *ret;
@@ -628,21 +770,21 @@ regatom(flagp)
 
 	*flagp = WORST; 			/* Tentatively. */
 
-	switch (getchr()) {
+	switch (getchr(rc)) {
 	  case Magic('^'):
-		ret = regnode(BOL);
+		ret = regnode(rc, BOL);
 		break;
 	  case Magic('$'):
-		ret = regnode(EOL);
+		ret = regnode(rc, EOL);
 		break;
 	  case Magic('<'):
-		ret = regnode(BOW);
+		ret = regnode(rc, BOW);
 		break;
 	  case Magic('>'):
-		ret = regnode(EOW);
+		ret = regnode(rc, EOW);
 		break;
 	  case Magic('.'):
-		ret = regnode(ANY);
+		ret = regnode(rc, ANY);
 		*flagp |= HASWIDTH | SIMPLE;
 		break;
 	  case Magic('['):{
@@ -650,45 +792,45 @@ regatom(flagp)
 			 * In a character class, different parsing rules apply.
 			 * Not even \ is special anymore, nothing is.
 			 */
-			if (*regparse == '^') { 	/* Complement of range. */
-				ret = regnode(ANYBUT);
-				regparse++;
+			if (*rc->rc_parse == '^') { 	/* Complement of range. */
+				ret = regnode(rc, ANYBUT);
+				rc->rc_parse++;
 			} else
-				ret = regnode(ANYOF);
-			if (*regparse == ']' || *regparse == '-')
-				regc(*regparse++);
-			while (*regparse != '\0' && *regparse != ']') {
-				if (*regparse == '-') {
-					regparse++;
-					if (*regparse == ']' || *regparse == '\0')
-						regc('-');
+				ret = regnode(rc, ANYOF);
+			if (*rc->rc_parse == ']' || *rc->rc_parse == '-')
+				regc(rc, *rc->rc_parse++);
+			while (*rc->rc_parse != '\0' && *rc->rc_parse != ']') {
+				if (*rc->rc_parse == '-') {
+					rc->rc_parse++;
+					if (*rc->rc_parse == ']' || *rc->rc_parse == '\0')
+						regc(rc, '-');
 					else {
 						register int	class;
 						register int	classend;
 
-						class = UCHARAT(regparse - 2) + 1;
-						classend = UCHARAT(regparse);
+						class = UCHARAT(rc->rc_parse - 2) + 1;
+						classend = UCHARAT(rc->rc_parse);
 						if (class > classend + 1)
 							EMSG_RETURN(e_invrange);
 						for (; class <= classend; class++)
-							regc(class);
-						regparse++;
+							regc(rc, class);
+						rc->rc_parse++;
 					}
-				} else if (*regparse == '\\' && regparse[1]) {
-					regparse++;
-					regc(*regparse++);
+				} else if (*rc->rc_parse == '\\' && rc->rc_parse[1]) {
+					rc->rc_parse++;
+					regc(rc, *rc->rc_parse++);
 				} else
-					regc(*regparse++);
+					regc(rc, *rc->rc_parse++);
 			}
-			regc('\0');
-			if (*regparse != ']')
+			regc(rc, '\0');
+			if (*rc->rc_parse != ']')
 				EMSG_RETURN(e_toomsbra);
-			skipchr();			/* let's be friends with the lexer again */
+			skipchr(rc);			/* let's be friends with the lexer again */
 			*flagp |= HASWIDTH | SIMPLE;
 		}
 		break;
 	  case Magic('('):
-		ret = reg(1, &flags);
+		ret = reg(rc, 1, &flags);
 		if (ret == NULL)
 			return NULL;
 		*flagp |= flags & (HASWIDTH | SPSTART);
@@ -705,7 +847,7 @@ regatom(flagp)
 		EMSG_RETURN((char_u *)"\\+ follows nothing");
 		/* break; Not Reached */
 	  case Magic('*'):
-		if (reg_magic)
+		if (rc->rc_magic)
 			EMSG_RETURN((char_u *)"* follows nothing")
 		else
 			EMSG_RETURN((char_u *)"\\* follows nothing")
@@ -715,12 +857,12 @@ regatom(flagp)
 			if (reg_prev_sub) {
 				register char_u *p;
 
-				ret = regnode(EXACTLY);
+				ret = regnode(rc, EXACTLY);
 				p = reg_prev_sub;
 				while (*p) {
-					regc(*p++);
+					regc(rc, *p++);
 				}
-				regc('\0');
+				regc(rc, '\0');
 				if (p - reg_prev_sub) {
 					*flagp |= HASWIDTH;
 					if ((p - reg_prev_sub) == 1)
@@ -742,8 +884,8 @@ regatom(flagp)
 	  case Magic('9'): {
 			int				refnum;
 
-			ungetchr();
-			refnum = getchr() - Magic('0');
+			ungetchr(rc);
+			refnum = getchr(rc) - Magic('0');
 			/*
 			 * Check if the back reference is legal. We use the parentheses
 			 * pointers to mark encountered close parentheses, but this
@@ -753,9 +895,9 @@ regatom(flagp)
 			 * is repeated (+*=): what instance of the repetition should
 			 * we match? TODO.
 			 */
-			if (refnum < regnpar &&
-				(regendp == NULL || regendp[refnum] != NULL))
-				ret = regnode(BACKREF + refnum);
+			if (refnum < rc->rc_npar &&
+				(rc->rc_endp == NULL || rc->rc_endp[refnum] != NULL))
+				ret = regnode(rc, BACKREF + refnum);
 			else
 				EMSG_RETURN((char_u *)"Illegal back reference");
 		}
@@ -765,13 +907,13 @@ regatom(flagp)
 			register int	len;
 			int				chr;
 
-			ungetchr();
+			ungetchr(rc);
 			len = 0;
-			ret = regnode(EXACTLY);
-			while ((chr = peekchr()) != '\0' && (chr < Magic(0)))
+			ret = regnode(rc, EXACTLY);
+			while ((chr = peekchr(rc)) != '\0' && (chr < Magic(0)))
 			{
-				regc(chr);
-				skipchr();
+				regc(rc, chr);
+				skipchr(rc);
 				len++;
 			}
 #ifdef DEBUG
@@ -784,11 +926,11 @@ regatom(flagp)
 			 */
 			if (len > 1 && ismult(chr))
 			{
-				unregc();			/* Back off of *+= operand */
-				ungetchr();			/* and put it back for next time */
+				unregc(rc);			/* Back off of *+= operand */
+				ungetchr(rc);			/* and put it back for next time */
 				--len;
 			}
-			regc('\0');
+			regc(rc, '\0');
 			*flagp |= HASWIDTH;
 			if (len == 1)
 				*flagp |= SIMPLE;
@@ -803,22 +945,23 @@ regatom(flagp)
  - regnode - emit a node
  */
 static char_u    *				/* Location. */
-regnode(op)
+regnode(rc, op)
+	RCSTATE		   *rc;
 	int			op;
 {
 	register char_u  *ret;
 	register char_u  *ptr;
 
-	ret = regcode;
+	ret = rc->rc_code;
 	if (ret == &regdummy) {
-		regsize += 3;
+		rc->rc_size += 3;
 		return ret;
 	}
 	ptr = ret;
 	*ptr++ = op;
 	*ptr++ = '\0';				/* Null "next" pointer. */
 	*ptr++ = '\0';
-	regcode = ptr;
+	rc->rc_code = ptr;
 
 	return ret;
 }
@@ -827,25 +970,27 @@ regnode(op)
  - regc - emit (if appropriate) a byte of code
  */
 static void
-regc(b)
+regc(rc, b)
+	RCSTATE		   *rc;
 	int			b;
 {
-	if (regcode != &regdummy)
-		*regcode++ = b;
+	if (rc->rc_code != &regdummy)
+		*rc->rc_code++ = b;
 	else
-		regsize++;
+		rc->rc_size++;
 }
 
 /*
  - unregc - take back (if appropriate) a byte of code
  */
 static void
-unregc()
+unregc(rc)
+	RCSTATE		   *rc;
 {
-	if (regcode != &regdummy)
-		regcode--;
+	if (rc->rc_code != &regdummy)
+		rc->rc_code--;
 	else
-		regsize--;
+		rc->rc_size--;
 }
 
 /*
@@ -854,7 +999,8 @@ unregc()
  * Means relocating the operand.
  */
 static void
-reginsert(op, opnd)
+reginsert(rc, op, opnd)
+	RCSTATE		   *rc;
 	int			op;
 	char_u		   *opnd;
 {
@@ -862,13 +1008,13 @@ reginsert(op, opnd)
 	register char_u  *dst;
 	register char_u  *place;
 
-	if (regcode == &regdummy) {
-		regsize += 3;
+	if (rc->rc_code == &regdummy) {
+		rc->rc_size += 3;
 		return;
 	}
-	src = regcode;
-	regcode += 3;
-	dst = regcode;
+	src = rc->rc_code;
+	rc->rc_code += 3;
+	dst = rc->rc_code;
 	while (src > opnd)
 		*--dst = *--src;
 
@@ -924,63 +1070,115 @@ regoptail(p, val)
 	regtail(OPERAND(p), val);
 }
 
+/*
+ - nfa_count_states - count the states for running the program as an NFA
+ *
+ * Every node that matches a character is a state, and every character of an
+ * EXACTLY operand.  END is the final state.  The count may be a bit too high,
+ * the operand of STAR and PLUS is counted as well.
+ * Returns zero when the program contains a back reference, the NFA can't
+ * match those, or when it has no choices at all, then backtracking never has
+ * to back up and is faster.
+ */
+static int
+nfa_count_states(r)
+	regexp		   *r;
+{
+	register char_u  *s;
+	register int	count = 0;
+	int				choice = FALSE;
+	char_u			*next;
+
+	for (s = r->program + 1; OP(s) != END; ) {
+		switch (OP(s)) {
+		  case BRANCH:
+			next = regnext(s);
+			if (next != NULL && OP(next) == BRANCH)
+				choice = TRUE;
+			break;
+		  case STAR:
+		  case PLUS:
+			choice = TRUE;
+			++count;
+			break;
+		  case ANY:
+		  case ANYOF:
+		  case ANYBUT:
+			++count;
+			break;
+		  case EXACTLY:
+			count += STRLEN(OPERAND(s));
+			break;
+		  default:
+			if (OP(s) > BACKREF && OP(s) <= BACKREF + 9)
+				return 0;
+			break;
+		}
+		if (OP(s) == ANYOF || OP(s) == ANYBUT || OP(s) == EXACTLY)
+			s = OPERAND(s) + STRLEN(OPERAND(s)) + 1;
+		else
+			s += 3;
+	}
+	if (!choice)
+		return 0;
+	return count + 1;
+}
+
 /*
  - getchr() - get the next character from the pattern. We know about
  * magic and such, so therefore we need a lexical analyzer.
  */
 
-/* static int		curchr; */
-static int		prevchr;
-static int		nextchr;	/* used for ungetchr() */
 /*
- * Note: prevchr is sometimes -1 when we are not at the start,
+ * Note: rc_prevchr is sometimes -1 when we are not at the start,
  * eg in /[ ^I]^ the pattern was never found even if it existed, because ^ was
  * taken to be magic -- webb
  */
-static int		at_start;	/* True when we are on the first character */
 
 static void
-initchr(str)
-char_u *str;
+initchr(rc, str)
+	RCSTATE		   *rc;
+	char_u		   *str;
 {
-	regparse = str;
-	curchr = prevchr = nextchr = -1;
-	at_start = TRUE;
+	rc->rc_parse = str;
+	rc->rc_curchr = rc->rc_prevchr = rc->rc_nextchr = -1;
+	rc->rc_at_start = TRUE;
 }
 
 static int
-peekchr()
+peekchr(rc)
+	RCSTATE		   *rc;
 {
-	if (curchr < 0) {
-		switch (curchr = regparse[0]) {
+	if (rc->rc_curchr < 0) {
+		switch (rc->rc_curchr = rc->rc_parse[0]) {
 		case '.':
 	/*	case '+':*/
 	/*	case '=':*/
 		case '[':
 		case '~':
-			if (reg_magic)
-				curchr = Magic(curchr);
+			if (rc->rc_magic)
+				rc->rc_curchr = Magic(rc->rc_curchr);
 			break;
 		case '*':
 			/* * is not magic as the very first character, eg "?*ptr" */
-			if (reg_magic && !at_start)
-				curchr = Magic('*');
+			if (rc->rc_magic && !rc->rc_at_start)
+				rc->rc_curchr = Magic('*');
 			break;
 		case '^':
 			/* ^ is only magic as the very first character */
-			if (at_start)
-				curchr = Magic('^');
+			if (rc->rc_at_start)
+				rc->rc_curchr = Magic('^');
 			break;
 		case '$':
 			/* $ is only magic as the very last character and in front of '\|' */
-			if (regparse[1] == NUL || (regparse[1] == '\\' && regparse[2] == '|'))
-				curchr = Magic('$');
+			if (rc->rc_parse[1] == NUL || (rc->rc_parse[1] == '\\' && rc->rc_parse[2] == '|'))
+				rc->rc_curchr = Magic('$');
 			break;
 		case '\\':
-			regparse++;
-			if (regparse[0] == NUL)
-				curchr = '\\';	/* trailing '\' */
-			else if (STRCHR(META, regparse[0]))
+			rc->rc_parse++;
+			if (rc->rc_parse[0] == NUL)
+				rc->rc_curchr = '\\';	/* trailing '\' */
+			else if (STRCHR(META, rc->rc_parse[0]))
 			{
 				/*
 				 * META contains everything that may be magic sometimes, except
@@ -988,10 +1186,10 @@ peekchr()
 				 * We now fetch the next character and toggle its magicness.
 				 * Therefore, \ is so meta-magic that it is not in META.
 				 */
-				curchr = -1;
-				at_start = FALSE;			/* We still want to be able to say "/\*ptr" */
-				peekchr();
-				curchr ^= Magic(0);
+				rc->rc_curchr = -1;
+				rc->rc_at_start = FALSE;			/* We still want to be able to say "/\*ptr" */
+				peekchr(rc);
+				rc->rc_curchr ^= Magic(0);
 			}
 			else
 			{
@@ -999,32 +1197,34 @@ peekchr()
 				 * Next character can never be (made) magic?
 				 * Then backslashing it won't do anything.
 				 */
-				curchr = regparse[0];
+				rc->rc_curchr = rc->rc_parse[0];
 			}
 			break;
 		}
 	}
 
-	return curchr;
+	return rc->rc_curchr;
 }
 
 static void
-skipchr()
+skipchr(rc)
+	RCSTATE		   *rc;
 {
-	regparse++;
-	at_start = FALSE;
-	prevchr = curchr;
-	curchr = nextchr;		/* use previously unget char, or -1 */
-	nextchr = -1;
+	rc->rc_parse++;
+	rc->rc_at_start = FALSE;
+	rc->rc_prevchr = rc->rc_curchr;
+	rc->rc_curchr = rc->rc_nextchr;		/* use previously unget char, or -1 */
+	rc->rc_nextchr = -1;
 }
 
 static int
-getchr()
+getchr(rc)
+	RCSTATE		   *rc;
 {
 	int chr;
 
-	chr = peekchr();
-	skipchr();
+	chr = peekchr(rc);
+	skipchr(rc);
 
 	return chr;
 }
@@ -1033,35 +1233,73 @@ getchr()
  * put character back. Works only once!
  */
 static void
-ungetchr()
+ungetchr(rc)
+	RCSTATE		   *rc;
 {
-	nextchr = curchr;
-	curchr = prevchr;
+	rc->rc_nextchr = rc->rc_curchr;
+	rc->rc_curchr = rc->rc_prevchr;
 	/*
-	 * Backup regparse as well; not because we will use what it points at,
-	 * but because skipchr() will bump it again.
+	 * Backup rc->rc_parse as well; not because we will use what it points at,
+	 * but because skipchr(rc) will bump it again.
 	 */
-	regparse--;
+	rc->rc_parse--;
 }
 
 /*
  * regexec and friends
  */
 
+typedef struct nfa_thread
+{
+	char_u		*nt_node;		/* the node */
+	char_u		*nt_opnd;		/* character in EXACTLY operand or NULL */
+	char_u		**nt_sub;		/* subexpression start and end positions */
+} NFA_THREAD;
+
 /*
- * Global work variables for regexec().
+ * Work variables for regexec().  They are kept in a REGSTATE, so that several
+ * threads can match at the same time, each with its own REGSTATE.
  */
-static char_u    *reginput;		/* String-input pointer. */
-static char_u    *regbol; 		/* Beginning of input, for ^ check. */
-static char_u   **regstartp;		/* Pointer to startp array. */
-/* static char_u   **regendp;	*/	/* Ditto for endp. */
+struct regstate
+{
+	char_u		*rs_input;		/* String-input pointer. */
+	char_u		*rs_bol;		/* Beginning of input, for ^ check. */
+	char_u		**rs_startp;	/* Pointer to startp array. */
+	char_u		**rs_endp;		/* Ditto for endp. */
+	int			rs_ic;			/* ignore case, regic of the regexp */
+
+	/* Work space for nfa_exec(), grown by nfa_alloc() when needed. */
+	NFA_THREAD	*rs_list[2];	/* state lists */
+	char_u		**rs_subs[2];	/* nt_sub for the lists */
+	int			rs_maxstate;	/* size of lists */
+	int			rs_maxsub;		/* number of subs per state */
+	int			*rs_mark;		/* rs_gen when a node was added */
+	int			rs_maxmark;		/* size of rs_mark */
+	int			rs_gen;			/* list number */
+
+	/* The list being built by nfa_add(). */
+	NFA_THREAD	*rs_new;		/* the list */
+	char_u		**rs_newsub;	/* subs for the list */
+	int			rs_count;		/* number of states in the list */
+	char_u		*rs_prog;		/* program of the regexp */
+	int			rs_nsub;		/* regnsub of the regexp */
+};
+
+static REGSTATE regstate_main;	/* used by regexec() */
 
 /*
  * Forwards.
  */
-static int		regtry __ARGS((regexp *, char_u *));
-static int		regmatch __ARGS((char_u *));
-static int		regrepeat __ARGS((char_u *));
+static int		regtry __ARGS((REGSTATE *, regexp *, char_u *));
+static int		regmatch __ARGS((REGSTATE *, char_u *));
+static int		regrepeat __ARGS((REGSTATE *, char_u *));
+static int		nfa_alloc __ARGS((REGSTATE *, regexp *));
+static int		nfa_exec __ARGS((REGSTATE *, regexp *, char_u *, int));
+static char_u	*nfa_last __ARGS((REGSTATE *, regexp *, char_u *, char_u *));
+static void		nfa_new_gen __ARGS((REGSTATE *));
+static void		nfa_add __ARGS((REGSTATE *, char_u *, char_u *, char_u **));
+static void		nfa_state __ARGS((REGSTATE *, char_u *, char_u *, char_u **));
+static int		nfa_simple __ARGS((char_u *, int, int));
 
 #ifdef DEBUG
 int 			regnarrate = 1;
@@ -1077,6 +1315,24 @@ regexec(prog, string, at_bol)
 	register regexp *prog;
 	register char_u  *string;
 	int 			at_bol;
+{
+	return regexec_state(&regstate_main, prog, string, at_bol);
+}
+
+/*
+ - regexec_state - match a regexp against a string, using work space 'rs'
+ *
+ * Does not change any global variable, several threads can call this at the
+ * same time, when each uses its own 'rs' and 'prog'.  The work space must
+ * have been made big enough for 'prog' by regstate_new(), allocating memory
+ * is not possible in a thread.
+ */
+int
+regexec_state(rs, prog, string, at_bol)
+	REGSTATE		*rs;
+	register regexp *prog;
+	register char_u  *string;
+	int 			at_bol;
 {
 	register char_u  *s;
 
@@ -1091,39 +1347,47 @@ regexec(prog, string, at_bol)
 		return 0;
 	}
 	/* If there is a "must appear" string, look for it. */
-	if (prog->regmust != NULL) {
-		s = string;
-		while ((s = cstrchr(s, prog->regmust[0])) != NULL) {
-			if (cstrncmp(s, prog->regmust, prog->regmlen) == 0)
-				break;			/* Found it. */
-			s++;
-		}
-		if (s == NULL)			/* Not present. */
-			return 0;
-	}
+	if (prog->regmust != NULL
+						&& cstrstr(string, prog->regmust, prog->regic) == NULL)
+		return 0;				/* Not present. */
+	rs->rs_ic = prog->regic;
 	/* Mark beginning of line for ^ . */
 	if (at_bol)
-		regbol = string;		/* is possible to match bol */
+		rs->rs_bol = string;		/* is possible to match bol */
 	else
-		regbol = NULL;			/* we aren't there, so don't match it */
+		rs->rs_bol = NULL;			/* we aren't there, so don't match it */
+
+	/*
+	 * Without a back reference the program can be run as an NFA, this takes
+	 * linear time. Backtracking can take exponential time.
+	 */
+	if (prog->regnstate > 0 && nfa_alloc(rs, prog))
+		return nfa_exec(rs, prog, string, FALSE);
 
 	/* Simplest case:  anchored match need be tried only once. */
 	if (prog->reganch)
-		return regtry(prog, string);
+		return regtry(rs, prog, string);
 
 	/* Messy cases:  unanchored match. */
 	s = string;
-	if (prog->regstart != '\0')
+	if (prog->regprefix != NULL)
+		/* We know what string it must start with. */
+		while ((s = cstrstr(s, prog->regprefix, prog->regic)) != NULL) {
+			if (regtry(rs, prog, s))
+				return 1;
+			s++;
+		}
+	else if (prog->regstart != '\0')
 		/* We know what char it must start with. */
-		while ((s = cstrchr(s, prog->regstart)) != NULL) {
-			if (regtry(prog, s))
+		while ((s = cstrchr(s, prog->regstart, prog->regic)) != NULL) {
+			if (regtry(rs, prog, s))
 				return 1;
 			s++;
 		}
 	else
 		/* We don't -- general case. */
 		do {
-			if (regtry(prog, s))
+			if (regtry(rs, prog, s))
 				return 1;
 		} while (*s++ != '\0');
 
@@ -1131,11 +1395,156 @@ regexec(prog, string, at_bol)
 	return 0;
 }
 
+/*
+ - regexec_last - find the match of 'prog' in 'string' that starts last
+ *
+ * When 'last' is not NULL the match must start at or before it.  Gives the
+ * same match as calling regexec() again just after the start of each match
+ * found, but without matching the same text over and over.
+ */
+int
+regexec_last(prog, string, at_bol, last)
+	register regexp *prog;
+	register char_u  *string;
+	int 			at_bol;
+	char_u		   *last;
+{
+	REGSTATE		*rs = &regstate_main;
+	register char_u  *s;
+
+	if (prog == NULL || string == NULL) {
+		emsg(e_null);
+		return 0;
+	}
+	if (UCHARAT(prog->program) != MAGIC) {
+		emsg(e_re_corr);
+		return 0;
+	}
+	if (prog->regmust != NULL
+						&& cstrstr(string, prog->regmust, prog->regic) == NULL)
+		return 0;
+	rs->rs_ic = prog->regic;
+	if (at_bol)
+		rs->rs_bol = string;
+	else
+		rs->rs_bol = NULL;
+
+	/*
+	 * Find where the last match starts in one pass with the NFA, then get
+	 * the end and the subexpressions of the match that starts there.
+	 */
+	if (prog->regnstate > 0 && nfa_alloc(rs, prog)) {
+		if ((s = nfa_last(rs, prog, string, last)) == NULL)
+			return 0;
+		return nfa_exec(rs, prog, s, TRUE);
+	}
+
+	if (prog->reganch)
+		return regtry(rs, prog, string);
+
+	/* Try each position, from the end backwards. */
+	s = string + STRLEN(string);
+	if (last != NULL && last < s)
+		s = last;
+	for (;;) {
+		if ((prog->regstart == '\0' || *s == prog->regstart
+					|| (rs->rs_ic && TO_UPPER(*s) == TO_UPPER(prog->regstart)))
+				&& regtry(rs, prog, s))
+			return 1;
+		if (s == string)
+			break;
+		--s;
+	}
+	return 0;
+}
+
+/*
+ - reg_must - get a literal string that every match of 'prog' contains
+ *
+ * Returns NULL if there is none.  Used to skip text that can't match before
+ * calling regexec().
+ */
+char_u *
+reg_must(prog)
+	regexp		   *prog;
+{
+	if (prog->regmust != NULL)
+		return prog->regmust;
+	return prog->regprefix;
+}
+
+/*
+ - regdup - make a copy of a compiled regexp
+ *
+ * The copy can be used by another thread, regexec_state() changes the
+ * startp[] and endp[] of the regexp it matches with.  Free it with free().
+ */
+regexp *
+regdup(prog)
+	regexp		   *prog;
+{
+	regexp		   *r;
+
+	r = (regexp *)alloc((unsigned)(sizeof(regexp) + prog->regplen));
+	if (r == NULL)
+		return NULL;
+	memmove((char *)r, (char *)prog, sizeof(regexp) + prog->regplen);
+	/* regmust and regprefix point into the program */
+	if (prog->regmust != NULL)
+		r->regmust = r->program + (prog->regmust - prog->program);
+	if (prog->regprefix != NULL)
+		r->regprefix = r->program + (prog->regprefix - prog->program);
+	return r;
+}
+
+/*
+ - regstate_new - allocate work space for regexec_state()
+ *
+ * It is made big enough for 'prog' right away.  Returns NULL when out of
+ * memory.
+ */
+REGSTATE *
+regstate_new(prog)
+	regexp		   *prog;
+{
+	REGSTATE	   *rs;
+
+	rs = (REGSTATE *)alloc((unsigned)sizeof(REGSTATE));
+	if (rs == NULL)
+		return NULL;
+	memset((char *)rs, 0, sizeof(REGSTATE));
+	if (prog->regnstate > 0 && !nfa_alloc(rs, prog)) {
+		regstate_free(rs);
+		return NULL;
+	}
+	return rs;
+}
+
+/*
+ - regstate_free - free work space allocated with regstate_new()
+ */
+void
+regstate_free(rs)
+	REGSTATE	   *rs;
+{
+	int				i;
+
+	if (rs == NULL)
+		return;
+	for (i = 0; i < 2; ++i) {
+		free(rs->rs_list[i]);
+		free(rs->rs_subs[i]);
+	}
+	free(rs->rs_mark);
+	free(rs);
+}
+
 /*
  - regtry - try match at specific point
  */
 static int						/* 0 failure, 1 success */
-regtry(prog, string)
+regtry(rs, prog, string)
+	REGSTATE		*rs;
 	regexp		   *prog;
 	char_u		   *string;
 {
@@ -1143,9 +1552,9 @@ regtry(prog, string)
 	register char_u **sp;
 	register char_u **ep;
 
-	reginput = string;
-	regstartp = prog->startp;
-	regendp = prog->endp;
+	rs->rs_input = string;
+	rs->rs_startp = prog->startp;
+	rs->rs_endp = prog->endp;
 
 	sp = prog->startp;
 	ep = prog->endp;
@@ -1153,9 +1562,9 @@ regtry(prog, string)
 		*sp++ = NULL;
 		*ep++ = NULL;
 	}
-	if (regmatch(prog->program + 1)) {
+	if (regmatch(rs, prog->program + 1)) {
 		prog->startp[0] = string;
-		prog->endp[0] = reginput;
+		prog->endp[0] = rs->rs_input;
 		return 1;
 	} else
 		return 0;
@@ -1172,7 +1581,8 @@ regtry(prog, string)
  * by recursion.
  */
 static int						/* 0 failure, 1 success */
-regmatch(prog)
+regmatch(rs, prog)
+	REGSTATE		*rs;
 	char_u		   *prog;
 {
 	register char_u  *scan;		/* Current node. */
@@ -1192,29 +1602,29 @@ regmatch(prog)
 		next = regnext(scan);
 		switch (OP(scan)) {
 		  case BOL:
-			if (reginput != regbol)
+			if (rs->rs_input != rs->rs_bol)
 				return 0;
 			break;
 		  case EOL:
-			if (*reginput != '\0')
+			if (*rs->rs_input != '\0')
 				return 0;
 			break;
-		  case BOW:		/* \<word; reginput points to w */
-		  	if (reginput != regbol && isidchar_id(reginput[-1]))
+		  case BOW:		/* \<word; rs_input points to w */
+		  	if (rs->rs_input != rs->rs_bol && isidchar_id(rs->rs_input[-1]))
 				return 0;
-		  	if (!reginput[0] || !isidchar_id(reginput[0]))
+		  	if (!rs->rs_input[0] || !isidchar_id(rs->rs_input[0]))
 				return 0;
 			break;
-		  case EOW:		/* word\>; reginput points after d */
-		  	if (reginput == regbol || !isidchar_id(reginput[-1]))
+		  case EOW:		/* word\>; rs_input points after d */
+		  	if (rs->rs_input == rs->rs_bol || !isidchar_id(rs->rs_input[-1]))
 				return 0;
-		  	if (reginput[0] && isidchar_id(reginput[0]))
+		  	if (rs->rs_input[0] && isidchar_id(rs->rs_input[0]))
 				return 0;
 			break;
 		  case ANY:
-			if (*reginput == '\0')
+			if (*rs->rs_input == '\0')
 				return 0;
-			reginput++;
+			rs->rs_input++;
 			break;
 		  case EXACTLY:{
 				register int	len;
@@ -1222,23 +1632,23 @@ regmatch(prog)
 
 				opnd = OPERAND(scan);
 				/* Inline the first character, for speed. */
-				if (*opnd != *reginput && (!reg_ic || TO_UPPER(*opnd) != TO_UPPER(*reginput)))
+				if (*opnd != *rs->rs_input && (!rs->rs_ic || TO_UPPER(*opnd) != TO_UPPER(*rs->rs_input)))
 					return 0;
 				len = STRLEN(opnd);
-				if (len > 1 && cstrncmp(opnd, reginput, len) != 0)
+				if (len > 1 && cstrncmp(opnd, rs->rs_input, len, rs->rs_ic) != 0)
 					return 0;
-				reginput += len;
+				rs->rs_input += len;
 			}
 			break;
 		  case ANYOF:
-			if (*reginput == '\0' || cstrchr(OPERAND(scan), *reginput) == NULL)
+			if (*rs->rs_input == '\0' || cstrchr(OPERAND(scan), *rs->rs_input, rs->rs_ic) == NULL)
 				return 0;
-			reginput++;
+			rs->rs_input++;
 			break;
 		  case ANYBUT:
-			if (*reginput == '\0' || cstrchr(OPERAND(scan), *reginput) != NULL)
+			if (*rs->rs_input == '\0' || cstrchr(OPERAND(scan), *rs->rs_input, rs->rs_ic) != NULL)
 				return 0;
-			reginput++;
+			rs->rs_input++;
 			break;
 		  case NOTHING:
 			break;
@@ -1257,25 +1667,25 @@ regmatch(prog)
 				register char_u  *save;
 
 				no = OP(scan) - MOPEN;
-				save = regstartp[no];
-				regstartp[no] = reginput; /* Tentatively */
+				save = rs->rs_startp[no];
+				rs->rs_startp[no] = rs->rs_input; /* Tentatively */
 #ifdef DEBUG
 				printf("MOPEN  %d pre  @'%s' ('%s' )'%s'\n",
 					no, save,
-					regstartp[no] ? regstartp[no] : "NULL",
-					regendp[no] ? regendp[no] : "NULL");
+					rs->rs_startp[no] ? rs->rs_startp[no] : "NULL",
+					rs->rs_endp[no] ? rs->rs_endp[no] : "NULL");
 #endif
 
-				if (regmatch(next)) {
+				if (regmatch(rs, next)) {
 #ifdef DEBUG
 				printf("MOPEN  %d post @'%s' ('%s' )'%s'\n",
 					no, save,
-					regstartp[no] ? regstartp[no] : "NULL",
-					regendp[no] ? regendp[no] : "NULL");
+					rs->rs_startp[no] ? rs->rs_startp[no] : "NULL",
+					rs->rs_endp[no] ? rs->rs_endp[no] : "NULL");
 #endif
 					return 1;
 				}
-				regstartp[no] = save;		/* We were wrong... */
+				rs->rs_startp[no] = save;		/* We were wrong... */
 				return 0;
 			}
 			/* break; Not Reached */
@@ -1292,25 +1702,25 @@ regmatch(prog)
 				register char_u  *save;
 
 				no = OP(scan) - MCLOSE;
-				save = regendp[no];
-				regendp[no] = reginput; /* Tentatively */
+				save = rs->rs_endp[no];
+				rs->rs_endp[no] = rs->rs_input; /* Tentatively */
 #ifdef DEBUG
 				printf("MCLOSE %d pre  @'%s' ('%s' )'%s'\n",
 					no, save,
-					regstartp[no] ? regstartp[no] : "NULL",
-					regendp[no] ? regendp[no] : "NULL");
+					rs->rs_startp[no] ? rs->rs_startp[no] : "NULL",
+					rs->rs_endp[no] ? rs->rs_endp[no] : "NULL");
 #endif
 
-				if (regmatch(next)) {
+				if (regmatch(rs, next)) {
 #ifdef DEBUG
 				printf("MCLOSE %d post @'%s' ('%s' )'%s'\n",
 					no, save,
-					regstartp[no] ? regstartp[no] : "NULL",
-					regendp[no] ? regendp[no] : "NULL");
+					rs->rs_startp[no] ? rs->rs_startp[no] : "NULL",
+					rs->rs_endp[no] ? rs->rs_endp[no] : "NULL");
 #endif
 					return 1;
 				}
-				regendp[no] = save;		/* We were wrong... */
+				rs->rs_endp[no] = save;		/* We were wrong... */
 				return 0;
 			}
 			/* break; Not Reached */
@@ -1328,11 +1738,11 @@ regmatch(prog)
 				int				len;
 
 				no = OP(scan) - BACKREF;
-				if (regendp[no] != NULL) {
-					len = (int)(regendp[no] - regstartp[no]);
-					if (cstrncmp(regstartp[no], reginput, len) != 0)
+				if (rs->rs_endp[no] != NULL) {
+					len = (int)(rs->rs_endp[no] - rs->rs_startp[no]);
+					if (cstrncmp(rs->rs_startp[no], rs->rs_input, len, rs->rs_ic) != 0)
 						return 0;
-					reginput += len;
+					rs->rs_input += len;
 				} else {
 					/*emsg("backref to 0-repeat");*/
 					/*return 0;*/
@@ -1347,10 +1757,10 @@ regmatch(prog)
 					next = OPERAND(scan);		/* Avoid recursion. */
 				else {
 					do {
-						save = reginput;
-						if (regmatch(OPERAND(scan)))
+						save = rs->rs_input;
+						if (regmatch(rs, OPERAND(scan)))
 							return 1;
-						reginput = save;
+						rs->rs_input = save;
 						scan = regnext(scan);
 					} while (scan != NULL && OP(scan) == BRANCH);
 					return 0;
@@ -1373,22 +1783,22 @@ regmatch(prog)
 				if (OP(next) == EXACTLY)
 				{
 					nextch = *OPERAND(next);
-					if (reg_ic)
+					if (rs->rs_ic)
 						nextch = TO_UPPER(nextch);
 				}
 				min = (OP(scan) == STAR) ? 0 : 1;
-				save = reginput;
-				no = regrepeat(OPERAND(scan));
+				save = rs->rs_input;
+				no = regrepeat(rs, OPERAND(scan));
 				while (no >= min)
 				{
 					/* If it could work, try it. */
-					if (nextch == '\0' || (*reginput == nextch ||
-									(reg_ic && TO_UPPER(*reginput) == nextch)))
-						if (regmatch(next))
+					if (nextch == '\0' || (*rs->rs_input == nextch ||
+									(rs->rs_ic && TO_UPPER(*rs->rs_input) == nextch)))
+						if (regmatch(rs, next))
 							return 1;
 					/* Couldn't or didn't -- back up. */
 					no--;
-					reginput = save + no;
+					rs->rs_input = save + no;
 				}
 				return 0;
 			}
@@ -1417,14 +1827,15 @@ regmatch(prog)
  - regrepeat - repeatedly match something simple, report how many
  */
 static int
-regrepeat(p)
+regrepeat(rs, p)
+	REGSTATE		*rs;
 	char_u		   *p;
 {
 	register int	count = 0;
 	register char_u  *scan;
 	register char_u  *opnd;
 
-	scan = reginput;
+	scan = rs->rs_input;
 	opnd = OPERAND(p);
 	switch (OP(p)) {
 	  case ANY:
@@ -1432,21 +1843,21 @@ regrepeat(p)
 		scan += count;
 		break;
 	  case EXACTLY:
-		while (*opnd == *scan || (reg_ic && TO_UPPER(*opnd) == TO_UPPER(*scan)))
+		while (*opnd == *scan || (rs->rs_ic && TO_UPPER(*opnd) == TO_UPPER(*scan)))
 		{
 			count++;
 			scan++;
 		}
 		break;
 	  case ANYOF:
-		while (*scan != '\0' && cstrchr(opnd, *scan) != NULL)
+		while (*scan != '\0' && cstrchr(opnd, *scan, rs->rs_ic) != NULL)
 		{
 			count++;
 			scan++;
 		}
 		break;
 	  case ANYBUT:
-		while (*scan != '\0' && cstrchr(opnd, *scan) == NULL) {
+		while (*scan != '\0' && cstrchr(opnd, *scan, rs->rs_ic) == NULL) {
 			count++;
 			scan++;
 		}
@@ -1456,7 +1867,7 @@ regrepeat(p)
 		count = 0;				/* Best compromise. */
 		break;
 	}
-	reginput = scan;
+	rs->rs_input = scan;
 
 	return count;
 }
@@ -1483,6 +1894,471 @@ regnext(p)
 		return p + offset;
 }
 
+/*
+ * The NFA matcher.
+ *
+ * The program is run as a Thompson NFA: All alternatives are followed at the
+ * same time, instead of trying them one by one and backing up.  A state is a
+ * node that matches one character (for EXACTLY the position in its operand).
+ * For each character of the string there is a list of the states that can be
+ * reached, in the order backtracking would try them.  Each state has a copy
+ * of the subexpression positions of the path that got there first.  When the
+ * same state is reached again later in the list that path is dropped, it
+ * can't result in another match than the first one.  When END is reached
+ * the states after it are dropped, this gives the same match as
+ * backtracking.  The work is proportional to the length of the string times
+ * the number of states.
+ */
+/*
+ - nfa_alloc - make sure the work space is big enough for 'prog'
+ *
+ * Returns FALSE when out of memory, backtracking is used then.
+ */
+static int
+nfa_alloc(rs, prog)
+	REGSTATE		*rs;
+	regexp		   *prog;
+{
+	int				i;
+	int				nsub;
+
+	if (prog->regplen > rs->rs_maxmark) {
+		free(rs->rs_mark);
+		rs->rs_maxmark = 0;
+		rs->rs_mark = (int *)lalloc((long_u)(prog->regplen * sizeof(int)), TRUE);
+		if (rs->rs_mark == NULL)
+			return FALSE;
+		for (i = 0; i < prog->regplen; ++i)
+			rs->rs_mark[i] = 0;
+		rs->rs_gen = 0;
+		rs->rs_maxmark = prog->regplen;
+	}
+	nsub = prog->regnsub * 2;
+	if (prog->regnstate > rs->rs_maxstate || nsub > rs->rs_maxsub) {
+		for (i = 0; i < 2; ++i) {
+			free(rs->rs_list[i]);
+			free(rs->rs_subs[i]);
+			rs->rs_list[i] = NULL;
+			rs->rs_subs[i] = NULL;
+		}
+		rs->rs_maxstate = 0;
+		if (nsub < rs->rs_maxsub)
+			nsub = rs->rs_maxsub;
+		for (i = 0; i < 2; ++i) {
+			rs->rs_list[i] = (NFA_THREAD *)lalloc((long_u)(prog->regnstate *
+												sizeof(NFA_THREAD)), TRUE);
+			rs->rs_subs[i] = (char_u **)lalloc((long_u)(prog->regnstate * nsub *
+												sizeof(char_u *)), TRUE);
+			if (rs->rs_list[i] == NULL || rs->rs_subs[i] == NULL)
+				return FALSE;
+		}
+		rs->rs_maxstate = prog->regnstate;
+		rs->rs_maxsub = nsub;
+	}
+	return TRUE;
+}
+
+/*
+ - nfa_exec - find the first match of 'prog' in 'string' with the NFA
+ *
+ * Like trying regtry() at each position, but in one pass over 'string'.
+ * When 'anchored' is TRUE only a match at the start of 'string' is tried.
+ */
+static int						/* 0 failure, 1 success */
+nfa_exec(rs, prog, string, anchored)
+	REGSTATE		*rs;
+	regexp		   *prog;
+	char_u		   *string;
+	int				anchored;
+{
+	register char_u  *s;
+	register int	c;
+	register int	i;
+	NFA_THREAD		*list;
+	NFA_THREAD		*t;
+	int				count;
+	int				no;
+	int				cur = 0;
+	int				matched = FALSE;
+	char_u			*sub[2 * NSUBEXP];
+
+	rs->rs_prog = prog->program;
+	rs->rs_nsub = prog->regnsub;
+	for (i = 0; i < 2 * rs->rs_nsub; ++i)
+		sub[i] = NULL;
+	if (prog->reganch)
+		anchored = TRUE;
+
+	rs->rs_new = rs->rs_list[cur];
+	rs->rs_newsub = rs->rs_subs[cur];
+	rs->rs_count = 0;
+	nfa_new_gen(rs);
+	for (s = string; ; ++s) {
+		/*
+		 * Start a match at this position, after the states of the matches
+		 * that started earlier.  Skip to a possible start when there are no
+		 * states.
+		 */
+		if (!matched && (!anchored || s == string)) {
+			if (rs->rs_count == 0 && !anchored && prog->regstart != '\0'
+					&& (s = (prog->regprefix != NULL
+								? cstrstr(s, prog->regprefix, prog->regic)
+								: cstrchr(s, prog->regstart, prog->regic))) == NULL)
+				break;
+			sub[0] = s;
+			nfa_add(rs, rs->rs_prog + 1, s, sub);
+		}
+		if (rs->rs_count == 0) {
+			if (matched || anchored || *s == '\0')
+				break;
+			nfa_new_gen(rs);	/* the next start must not see these marks */
+			continue;
+		}
+
+		/* Make the list of states for the next character. */
+		c = *s;
+		list = rs->rs_new;
+		count = rs->rs_count;
+		cur = !cur;
+		rs->rs_new = rs->rs_list[cur];
+		rs->rs_newsub = rs->rs_subs[cur];
+		rs->rs_count = 0;
+		nfa_new_gen(rs);
+		for (i = 0; i < count; ++i) {
+			t = &list[i];
+			if (OP(t->nt_node) == END) {
+				/* Found a match, the states after this one can't do better */
+				for (no = 0; no < NSUBEXP; ++no) {
+					if (no < rs->rs_nsub) {
+						prog->startp[no] = t->nt_sub[no];
+						prog->endp[no] = t->nt_sub[rs->rs_nsub + no];
+					} else {
+						prog->startp[no] = NULL;
+						prog->endp[no] = NULL;
+					}
+				}
+				prog->endp[0] = s;
+				matched = TRUE;
+				break;
+			}
+			if (c == '\0')
+				continue;
+			switch (OP(t->nt_node)) {
+			  case EXACTLY:
+				if (*t->nt_opnd != c && (!rs->rs_ic ||
+									TO_UPPER(*t->nt_opnd) != TO_UPPER(c)))
+					continue;
+				if (t->nt_opnd[1] != '\0') {
+					nfa_state(rs, t->nt_node, t->nt_opnd + 1, t->nt_sub);
+					continue;
+				}
+				break;
+			  case ANY:
+			  case ANYOF:
+			  case ANYBUT:
+				if (!nfa_simple(t->nt_node, c, rs->rs_ic))
+					continue;
+				break;
+			  case STAR:
+			  case PLUS:
+				if (!nfa_simple(OPERAND(t->nt_node), c, rs->rs_ic))
+					continue;
+				nfa_state(rs, t->nt_node, NULL, t->nt_sub);	/* match more */
+				break;
+			}
+			nfa_add(rs, regnext(t->nt_node), s + 1, t->nt_sub);
+		}
+		if (c == '\0')
+			break;
+	}
+	return matched;
+}
+
+/*
+ - nfa_last - find where the last match of 'prog' in 'string' starts
+ *
+ * A match that starts later is put before the ones that started earlier, so
+ * that it wins when two of them get to the same state.  'last' is NULL or the
+ * last position where a match may start.  Returns NULL when there is no match.
+ */
+static char_u *
+nfa_last(rs, prog, string, last)
+	REGSTATE		*rs;
+	regexp		   *prog;
+	char_u		   *string;
+	char_u		   *last;
+{
+	register char_u  *s;
+	register int	c;
+	register int	i;
+	NFA_THREAD		*list = NULL;
+	NFA_THREAD		*t;
+	int				count = 0;
+	int				cur = 0;
+	int				done;
+	char_u			*best = NULL;
+	char_u			*sub[2 * NSUBEXP];
+
+	rs->rs_prog = prog->program;
+	rs->rs_nsub = prog->regnsub;
+	for (i = 0; i < 2 * rs->rs_nsub; ++i)
+		sub[i] = NULL;
+
+	for (s = string; ; ++s) {
+		done = (s != string && s[-1] == '\0');
+		if (count == 0) {
+			/* No states, skip to a possible start. */
+			if (done || (prog->reganch && s != string)
+										|| (last != NULL && s > last))
+				break;
+			if (prog->regstart != '\0'
+					&& (s = (prog->regprefix != NULL
+								? cstrstr(s, prog->regprefix, prog->regic)
+								: cstrchr(s, prog->regstart, prog->regic))) == NULL)
+				break;
+			if (last != NULL && s > last)
+				break;
+		}
+
+		/* Make the list of states for this position. */
+		cur = !cur;
+		rs->rs_new = rs->rs_list[cur];
+		rs->rs_newsub = rs->rs_subs[cur];
+		rs->rs_count = 0;
+		nfa_new_gen(rs);
+		if (!done && (last == NULL || s <= last)
+				&& (!prog->reganch || s == string)
+				&& (prog->regstart == '\0' || *s == prog->regstart
+					|| (rs->rs_ic && TO_UPPER(*s) == TO_UPPER(prog->regstart)))) {
+			sub[0] = s;
+			nfa_add(rs, rs->rs_prog + 1, s, sub);
+		}
+
+		/* Continue the matches that started earlier with the character before
+		 * this position. */
+		c = (s == string ? '\0' : s[-1]);
+		for (i = 0; i < count; ++i) {
+			t = &list[i];
+			if (best != NULL && t->nt_sub[0] <= best)
+				break;				/* can't start later than "best" */
+			if (OP(t->nt_node) == END) {
+				best = t->nt_sub[0];
+				break;
+			}
+			if (c == '\0')
+				continue;
+			switch (OP(t->nt_node)) {
+			  case EXACTLY:
+				if (*t->nt_opnd != c && (!rs->rs_ic ||
+									TO_UPPER(*t->nt_opnd) != TO_UPPER(c)))
+					continue;
+				if (t->nt_opnd[1] != '\0') {
+					nfa_state(rs, t->nt_node, t->nt_opnd + 1, t->nt_sub);
+					continue;
+				}
+				break;
+			  case ANY:
+			  case ANYOF:
+			  case ANYBUT:
+				if (!nfa_simple(t->nt_node, c, rs->rs_ic))
+					continue;
+				break;
+			  case STAR:
+			  case PLUS:
+				if (!nfa_simple(OPERAND(t->nt_node), c, rs->rs_ic))
+					continue;
+				nfa_state(rs, t->nt_node, NULL, t->nt_sub);	/* match more */
+				break;
+			}
+			nfa_add(rs, regnext(t->nt_node), s, t->nt_sub);
+		}
+		if (done)
+			break;
+		list = rs->rs_new;
+		count = rs->rs_count;
+	}
+	return best;
+}
+
+/*
+ - nfa_new_gen - start a new list: nodes marked for the old one can be added
+ */
+static void
+nfa_new_gen(rs)
+	REGSTATE		*rs;
+{
+	register int	i;
+
+	if (++rs->rs_gen == 0x7fffffff) {	/* avoid overflow */
+		for (i = 0; i < rs->rs_maxmark; ++i)
+			rs->rs_mark[i] = 0;
+		rs->rs_gen = 1;
+	}
+}
+
+/*
+ - nfa_add - add the states reached from 'node' at input position 's'
+ *
+ * Nodes that don't match a character are followed here.  'sub' holds the
+ * subexpression positions, it is changed but restored before returning.
+ */
+static void
+nfa_add(rs, node, s, sub)
+	REGSTATE		*rs;
+	char_u		   *node;
+	char_u		   *s;
+	char_u		  **sub;
+{
+	register char_u  *next;
+	char_u			*save;
+	int				no;
+
+	while (node != NULL) {
+		if (rs->rs_mark[node - rs->rs_prog] == rs->rs_gen)
+			return;				/* got here before */
+		rs->rs_mark[node - rs->rs_prog] = rs->rs_gen;
+		next = regnext(node);
+		switch (OP(node)) {
+		  case BOL:
+			if (s != rs->rs_bol)
+				return;
+			break;
+		  case EOL:
+			if (*s != '\0')
+				return;
+			break;
+		  case BOW:
+		  	if (s != rs->rs_bol && isidchar_id(s[-1]))
+				return;
+		  	if (!s[0] || !isidchar_id(s[0]))
+				return;
+			break;
+		  case EOW:
+		  	if (s == rs->rs_bol || !isidchar_id(s[-1]))
+				return;
+		  	if (s[0] && isidchar_id(s[0]))
+				return;
+			break;
+		  case NOTHING:
+		  case BACK:
+			break;
+		  case BRANCH:
+			if (OP(next) != BRANCH)		/* No choice. */
+				next = OPERAND(node);
+			else {
+				do {
+					nfa_add(rs, OPERAND(node), s, sub);
+					node = regnext(node);
+				} while (node != NULL && OP(node) == BRANCH);
+				return;
+			}
+			break;
+		  case MOPEN + 1:
+		  case MOPEN + 2:
+		  case MOPEN + 3:
+		  case MOPEN + 4:
+		  case MOPEN + 5:
+		  case MOPEN + 6:
+		  case MOPEN + 7:
+		  case MOPEN + 8:
+		  case MOPEN + 9:
+			no = OP(node) - MOPEN;
+			save = sub[no];
+			sub[no] = s;
+			nfa_add(rs, next, s, sub);
+			sub[no] = save;
+			return;
+		  case MCLOSE + 1:
+		  case MCLOSE + 2:
+		  case MCLOSE + 3:
+		  case MCLOSE + 4:
+		  case MCLOSE + 5:
+		  case MCLOSE + 6:
+		  case MCLOSE + 7:
+		  case MCLOSE + 8:
+		  case MCLOSE + 9:
+			no = rs->rs_nsub + OP(node) - MCLOSE;
+			save = sub[no];
+			sub[no] = s;
+			nfa_add(rs, next, s, sub);
+			sub[no] = save;
+			return;
+		  case EXACTLY:
+			if (*OPERAND(node) == '\0')	/* empty "~" */
+				break;
+			nfa_state(rs, node, OPERAND(node), sub);
+			return;
+		  case STAR:
+			nfa_state(rs, node, NULL, sub);	/* match one, or skip it */
+			break;
+		  case PLUS:
+		  case ANY:
+		  case ANYOF:
+		  case ANYBUT:
+		  case END:
+			nfa_state(rs, node, NULL, sub);
+			return;
+		  default:
+			emsg(e_re_corr);
+			return;
+		}
+		node = next;
+	}
+}
+
+/*
+ - nfa_state - add a state to the list, unless it's already there
+ *
+ * The mark for a state is at its operand character for EXACTLY, otherwise
+ * at the byte after the opcode, nfa_add(rs, ) uses the opcode itself.
+ */
+static void
+nfa_state(rs, node, opnd, sub)
+	REGSTATE		*rs;
+	char_u		   *node;
+	char_u		   *opnd;
+	char_u		  **sub;
+{
+	register int	i;
+	register int	*mp;
+	NFA_THREAD		*t;
+
+	mp = &rs->rs_mark[(opnd != NULL ? opnd : node + 1) - rs->rs_prog];
+	if (*mp == rs->rs_gen)
+		return;
+	*mp = rs->rs_gen;
+	t = &rs->rs_new[rs->rs_count];
+	t->nt_node = node;
+	t->nt_opnd = opnd;
+	t->nt_sub = rs->rs_newsub + rs->rs_count * rs->rs_maxsub;
+	for (i = 2 * rs->rs_nsub; --i >= 0; )
+		t->nt_sub[i] = sub[i];
+	++rs->rs_count;
+}
+
+/*
+ - nfa_simple - check if character 'c' matches a simple node
+ */
+static int
+nfa_simple(node, c, ic)
+	char_u		   *node;
+	int				c;
+	int				ic;
+{
+	switch (OP(node)) {
+	  case ANY:
+		return TRUE;
+	  case EXACTLY:
+		return (*OPERAND(node) == c ||
+						(ic && TO_UPPER(*OPERAND(node)) == TO_UPPER(c)));
+	  case ANYOF:
+		return (cstrchr(OPERAND(node), c, ic) != NULL);
+	  case ANYBUT:
+		return (cstrchr(OPERAND(node), c, ic) == NULL);
+	}
+	return FALSE;
+}
+
 #ifdef DEBUG
 
 /*
@@ -1658,15 +2534,16 @@ strcspn(s1, s2)
 #endif
 
 /*
- * Compare two strings, ignore case if reg_ic set.
+ * Compare two strings, ignore case if 'ic' set.
  * Return 0 if strings match, non-zero otherwise.
  */
 	int
-cstrncmp(s1, s2, n)
+cstrncmp(s1, s2, n, ic)
 	char_u		   *s1, *s2;
 	int 			n;
+	int				ic;
 {
-	if (!reg_ic)
+	if (!ic)
 		return STRNCMP(s1, s2, (size_t)n);
 
 	return vim_strnicmp(s1, s2, (size_t)n);
@@ -1674,23 +2551,46 @@ cstrncmp(s1, s2, n)
 
 /*
  * cstrchr: This function is used a lot for simple searches, keep it fast!
+ * The library functions are usually much faster than a loop, when ignoring
+ * case strpbrk() is used to find either the upper or lower case character.
  */
 	char_u *
-cstrchr(s, c)
+cstrchr(s, c, ic)
 	char_u		   *s;
 	register int	c;
+	int				ic;
 {
-	register char_u		   *p;
+	char_u			both[3];
 
-	if (!reg_ic)
+	if (!ic)
 		return STRCHR(s, c);
 
-	c = TO_UPPER(c);
+	both[0] = TO_UPPER(c);
+	both[1] = TO_LOWER(both[0]);
+	if (both[0] == both[1])
+		return STRCHR(s, c);
+	both[2] = NUL;
+	return (char_u *)strpbrk((char *)s, (char *)both);
+}
 
-	for (p = s; *p; p++)
-	{
-		if (TO_UPPER(*p) == c)
-			return p;
-	}
-	return NULL;
+/*
+ * cstrstr: find string 'p' in 's', ignore case if 'ic' set.
+ * Return a pointer to the match or NULL.
+ */
+	char_u *
+cstrstr(s, p, ic)
+	char_u		   *s;
+	char_u		   *p;
+	int				ic;
+{
+	int				len;
+
+	if (!ic)
+		return (char_u *)strstr((char *)s, (char *)p);
+
+	len = STRLEN(p);
+	for ( ; (s = cstrchr(s, *p, TRUE)) != NULL; ++s)
+		if (vim_strnicmp(s, p, (size_t)len) == 0)
+			break;
+	return s;
 }
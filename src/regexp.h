@@ -26,24 +26,36 @@ typedef struct regexp {
 	char_u			regstart;	/* Internal use only. */
 	char_u			reganch;	/* Internal use only. */
 	char_u		   *regmust;	/* Internal use only. */
+	char_u		   *regprefix;	/* Internal use only. */
 	int 			regmlen;	/* Internal use only. */
+	int				regnstate;	/* Internal use only. */
+	int				regplen;	/* Internal use only. */
+	char_u			regnsub;	/* Internal use only. */
+	char_u			regic;		/* ignore case when matching */
 	char_u			program[1]; /* Unwarranted chumminess with compiler. */
 }				regexp;
 
+/* work space for regexec_state(), defined in regexp.c */
+typedef struct regstate REGSTATE;
+
 /* regexp.c */
-regexp *regcomp __ARGS((char_u *));
+regexp *regcomp __ARGS((char_u *, int, int));
+regexp *regcomp_cached __ARGS((char_u *, int, int));
+void regcache_statistics __ARGS((void));
 int regexec __ARGS((regexp *, char_u *, int));
-/* int cstrncmp __ARGS((char_u *, char_u *, int)); */
-char_u *cstrchr __ARGS((char_u *, int));
+int regexec_state __ARGS((REGSTATE *, regexp *, char_u *, int));
+int regexec_last __ARGS((regexp *, char_u *, int, char_u *));
+regexp *regdup __ARGS((regexp *));
+REGSTATE *regstate_new __ARGS((regexp *));
+void regstate_free __ARGS((REGSTATE *));
+/* int cstrncmp __ARGS((char_u *, char_u *, int, int)); */
+char_u *cstrchr __ARGS((char_u *, int, int));
+char_u *cstrstr __ARGS((char_u *, char_u *, int));
+char_u *reg_must __ARGS((regexp *));
 
 /* regsub.c */
 int regsub __ARGS((regexp *, char_u *, char_u *, int, int));
 
 /* search.c */
 extern void 	regerror __ARGS((char_u *));
-
-#ifndef ORIGINAL
-extern int		reg_ic; 		/* set non-zero to ignore case in searches */
-extern int		reg_magic;		/* set zero to disable magicness of .*[~& */
-#endif
 #endif	/* _REGEXP_H */
@@ -31,8 +31,9 @@
  *
  * $Log:		regsub.c,v $
  * Revision 1.2  88/04/28  08:11:25  tony
- * First modification of the regexp library. Added an external variable
- * 'reg_ic' which can be set to indicate that case should be ignored.
+ * First modification of the regexp library. Added a way to indicate that
+ * case should be ignored: the 'ic' argument of regcomp(), which is stored
+ * in the compiled program (regic).
  * Added a new parameter to regexec() to indicate that the given string
  * comes from the beginning of a line and is thus eligible to match
  * 'beginning-of-line'.
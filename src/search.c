@@ -18,9 +18,17 @@
 /* modified Henry Spencer's regular expression routines */
 #include "regexp.h"
 
+#ifdef USE_PTHREAD
+# include <pthread.h>
+# include <signal.h>
+#endif
+
 static int inmacro __ARGS((char_u *, char_u *));
 static int cls __ARGS((void));
 static void show_pat_in_path __ARGS((char_u *, int, int, int, FILE *, linenr_t *, long));
+#ifdef USE_PTHREAD
+static void *search_worker __ARGS((void *));
+#endif
 
 static char_u *top_bot_msg = (char_u *)"search hit TOP, continuing at BOTTOM";
 static char_u *bot_top_msg = (char_u *)"search hit BOTTOM, continuing at TOP";
@@ -56,6 +64,7 @@ static char_u *bot_top_msg = (char_u *)"search hit BOTTOM, continuing at TOP";
 static char_u 	*search_pattern = NULL;
 static char_u 	*subst_pattern = NULL;
 static char_u 	*last_pattern = NULL;
+static int		last_magic = TRUE;		/* 'magic' when a pattern was saved */
 
 static int		want_start;				/* looking for start of line? */
 static int		mr_did_emsg;			/* myregcomp() called emsg() */
@@ -136,7 +145,7 @@ myregcomp(pat, sub_cmd, which_pat)
 				free(search_pattern);
 				search_pattern = strsave(pat);
 				last_pattern = search_pattern;
-				reg_magic = p_magic;		/* Magic sticks with the r.e. */
+				last_magic = p_magic;		/* Magic sticks with the r.e. */
 			}
 		}
 		if (sub_cmd == 1 || sub_cmd == 2)	/* substitute or global command */
@@ -146,14 +155,13 @@ myregcomp(pat, sub_cmd, which_pat)
 				free(subst_pattern);
 				subst_pattern = strsave(pat);
 				last_pattern = subst_pattern;
-				reg_magic = p_magic;		/* Magic sticks with the r.e. */
+				last_magic = p_magic;		/* Magic sticks with the r.e. */
 			}
 		}
 	}
 
 	want_start = (*pat == '^');		/* looking for start of line? */
-	reg_ic = p_ic;					/* tell the regexec routine how to search */
-	return regcomp(pat);
+	return regcomp_cached(pat, last_magic, p_ic);
 }
 
 /*
@@ -181,6 +189,9 @@ searchit(pos, dir, str, count, end, message, which_pat)
 	register int		i;
 	register char_u		*match = NULL, *matchend = NULL;	/* init for GCC */
 	int 				loop;
+	char_u				*must;
+	linenr_t			nextlnum;
+	linenr_t			limit;
 
 	if ((prog = myregcomp(str, 0, which_pat)) == NULL)
 	{
@@ -188,6 +199,7 @@ searchit(pos, dir, str, count, end, message, which_pat)
 			emsg(e_invstring);
 		return FAIL;
 	}
+	must = reg_must(prog);		/* literal string in every match */
 /*
  * find the string
  */
@@ -207,6 +219,35 @@ searchit(pos, dir, str, count, end, message, which_pat)
 		{
 			for ( ; lnum > 0 && lnum <= curbuf->b_ml.ml_line_count; lnum += dir, i = -1)
 			{
+				/*
+				 * Skip lines without the literal string a match needs. The
+				 * text in the data blocks is searched, that is much faster
+				 * than getting each line. With 'searchthreads' skip to the
+				 * first matching line, found by several threads. Not for the
+				 * line where the search starts, only part of it is searched.
+				 */
+				if (i < 0 && (must != NULL || p_sth > 1))
+				{
+					limit = loop ? startlnum :
+							(dir == FORWARD ? curbuf->b_ml.ml_line_count : 1);
+#ifdef USE_PTHREAD
+					if (p_sth <= 1 || search_parallel(prog, lnum, limit, dir,
+												NUL, &nextlnum) == FAIL)
+#endif
+						nextlnum = (must == NULL ? lnum :
+							ml_find_string(lnum, limit, dir, must, prog->regic));
+					if (got_int)
+						break;
+					if (nextlnum == 0)		/* no more matches */
+					{
+						if (!loop)
+							lnum = (dir == FORWARD ?
+										curbuf->b_ml.ml_line_count + 1 : 0);
+						break;
+					}
+					lnum = nextlnum;
+				}
+
 				s = ptr = ml_get(lnum);
 				if (dir == FORWARD && i > 0)    /* first line for forward search */
 				{
@@ -215,29 +256,16 @@ searchit(pos, dir, str, count, end, message, which_pat)
 					s += i;
 				}
 
-				if (regexec(prog, s, dir == BACKWARD || i <= 0))
+				/*
+				 * When searching backward we need the last match in the line.
+				 * Or the last one before the cursor, if we're on that line.
+				 */
+				if (dir == BACKWARD && !want_start
+						? regexec_last(prog, s, TRUE, i >= 0 ? s + i : NULL)
+						: regexec(prog, s, dir == BACKWARD || i <= 0))
 				{							/* match somewhere on line */
 					match = prog->startp[0];
 					matchend = prog->endp[0];
-					if (dir == BACKWARD && !want_start)
-					{
-						/*
-						 * Now, if there are multiple matches on this line,
-						 * we have to get the last one. Or the last one before
-						 * the cursor, if we're on that line.
-						 */
-						while (*match != NUL && regexec(prog, match + 1, (int)FALSE))
-						{
-							if ((i >= 0) && ((prog->startp[0] - s) > i))
-								break;
-							match = prog->startp[0];
-							matchend = prog->endp[0];
-						}
-
-						if ((i >= 0) && ((match - s) > i))
-							continue;
-					}
-
 					pos->lnum = lnum;
 					if (end)
 						pos->col = (int) (matchend - ptr - 1);
@@ -316,6 +344,552 @@ searchit(pos, dir, str, count, end, message, which_pat)
 	return OK;
 }
 
+#ifdef USE_PTHREAD
+/*
+ * Searching with several threads, for 'searchthreads'.
+ * The main thread copies a batch of data blocks with ml_copy_block(). The
+ * blocks are divided over the threads, each matches the lines in its part
+ * with its own copy of the regexp and work space. The main thread does the
+ * first part itself. The results are then used in line order. The threads
+ * don't use global variables.
+ */
+#define SEARCH_MAX_THREADS	32		/* maximum number of threads */
+#define SEARCH_MAX_BATCH	16		/* maximum number of blocks per thread */
+#define SEARCH_SUB_LINES	200		/* changed lines put in the buffer at once */
+
+typedef struct search_block
+{
+	char_u		*sb_data;		/* copy of the data block */
+	unsigned	sb_size;		/* number of bytes allocated for sb_data */
+	linenr_t	sb_low;			/* first line in the block */
+	linenr_t	sb_first;		/* first line to match */
+	linenr_t	sb_last;		/* last line to match */
+	char_u		*sb_match;		/* for each line: TRUE when matching (:g) */
+	linenr_t	sb_msize;		/* number of bytes allocated for sb_match */
+	char_u		*sb_text;		/* new text of the matching lines (:s) */
+	unsigned	sb_tsize;		/* number of bytes allocated for sb_text */
+	unsigned	sb_tlen;		/* number of bytes used in sb_text */
+	long		sb_nsubs;		/* number of substitutions (:s) */
+	linenr_t	sb_stop;		/* line that didn't fit in sb_text, or 0 */
+} SEARCHBLOCK;
+
+typedef struct search_job
+{
+	regexp		*sj_prog;		/* copy of the regexp */
+	REGSTATE	*sj_state;		/* work space for regexec_state() */
+	SEARCHBLOCK	*sj_blocks;		/* first block to search */
+	int			sj_count;		/* number of blocks */
+	int			sj_dir;			/* FORWARD or BACKWARD */
+	int			sj_all;			/* TRUE: match all lines (for :g) */
+	linenr_t	sj_found;		/* first matching line, 0 if none */
+	char_u		*sj_sub;		/* substitute string (:s), or NULL */
+	int			sj_global;		/* substitute all matches in a line */
+	int			sj_magic;		/* 'magic' for sj_sub */
+} SEARCHJOB;
+
+static int search_start __ARGS((SEARCHJOB *, int, regexp *, SEARCHBLOCK **));
+static int search_batch __ARGS((SEARCHJOB *, int, SEARCHBLOCK *, int, linenr_t *, linenr_t, int, int));
+static void search_end __ARGS((SEARCHJOB *, int, SEARCHBLOCK *));
+static int sub_line __ARGS((SEARCHJOB *, SEARCHBLOCK *, char_u *));
+
+/*
+ * Search for 'prog' in lines 'lnum' to 'last', in direction 'dir', with
+ * 'searchthreads' threads.
+ * When 'type' is NUL '*resultp' is set to the first matching line, zero
+ * when there is none.
+ * When 'type' is 'g' or 'v' ml_setmarked() is called for each (not)
+ * matching line, for ":global". '*resultp' is set to the number of marked
+ * lines.
+ *
+ * return FAIL when no threads can be used, the caller has to search.
+ */
+	int
+search_parallel(prog, lnum, last, dir, type, resultp)
+	regexp		*prog;
+	linenr_t	lnum;
+	linenr_t	last;
+	int			dir;
+	int			type;
+	linenr_t	*resultp;
+{
+	SEARCHJOB	job[SEARCH_MAX_THREADS];
+	SEARCHBLOCK	*blocks;
+	SEARCHBLOCK	*sb;
+	int			nthreads;
+	int			nblocks;
+	int			batch;			/* number of blocks per thread */
+	int			i;
+	linenr_t	l;
+	int			retval = FAIL;
+
+	if (dir == FORWARD ? lnum > last : lnum < last)
+		return FAIL;
+	if ((nthreads = search_start(job, SEARCH_MAX_THREADS, prog, &blocks)) == 0)
+		return FAIL;
+
+	*resultp = 0;
+	batch = 1;
+	while (dir == FORWARD ? lnum <= last : lnum >= last)
+	{
+		/* Start with one block per thread, the match may be close. */
+		if ((nblocks = search_batch(job, nthreads, blocks, batch, &lnum, last,
+														dir, type)) < 0)
+			break;
+		retval = OK;
+
+		/*
+		 * Use the results in line order.
+		 */
+		if (type == NUL)
+		{
+			for (i = 0; i < nthreads; ++i)
+				if (job[i].sj_count > 0 && job[i].sj_found != 0)
+				{
+					*resultp = job[i].sj_found;
+					goto theend;
+				}
+		}
+		else
+		{
+			for (i = 0; i < nblocks; ++i)
+			{
+				sb = &blocks[i];
+				for (l = sb->sb_first; l <= sb->sb_last; ++l)
+					if (sb->sb_match[l - sb->sb_low] == (type == 'g'))
+					{
+						ml_setmarked(l);
+						++*resultp;
+					}
+			}
+		}
+
+		breakcheck();
+		if (got_int)
+			break;
+		if (batch < SEARCH_MAX_BATCH)
+			batch *= 2;
+	}
+
+theend:
+	search_end(job, nthreads, blocks);
+	return retval;
+}
+
+/*
+ * Substitute 'sub' for matches of 'prog' in lines 'lnum' to 'last' with
+ * 'searchthreads' threads, for ":s" without confirmation.  When 'global' is
+ * TRUE all matches in a line are substituted, otherwise the first one.
+ * The substitute string must not contain a CR, the threads can't break
+ * lines.  The threads compute the new lines, the main thread puts them in
+ * the buffer in line order and saves them for undo.
+ * '*nsubsp' is incremented by the number of substitutions, '*nlinesp' by
+ * the number of changed lines.  '*lastp' is set to the last changed line.
+ *
+ * return FAIL when no threads can be used, the caller has to substitute.
+ */
+	int
+sub_parallel(prog, sub, lnum, last, global, nsubsp, nlinesp, lastp)
+	regexp		*prog;
+	char_u		*sub;
+	linenr_t	lnum;
+	linenr_t	last;
+	int			global;
+	long		*nsubsp;
+	linenr_t	*nlinesp;
+	linenr_t	*lastp;
+{
+	SEARCHJOB	job[SEARCH_MAX_THREADS];
+	SEARCHBLOCK	*blocks;
+	SEARCHBLOCK	*sb;
+	char_u		*lines[SEARCH_SUB_LINES];	/* changed lines not in buffer */
+	linenr_t	top = 0;		/* line number of lines[0] */
+	int			count = 0;		/* number of lines in lines[] */
+	char_u		*p;
+	char_u		*s;
+	unsigned	len;
+	int			nthreads;
+	int			nblocks;
+	int			batch;
+	int			i;
+	linenr_t	first;
+	linenr_t	l;
+	int			retval = FAIL;
+
+	if (lnum > last)
+		return FAIL;
+	if ((nthreads = search_start(job, SEARCH_MAX_THREADS, prog, &blocks)) == 0)
+		return FAIL;
+	for (i = 0; i < nthreads; ++i)
+	{
+		job[i].sj_sub = sub;
+		job[i].sj_global = global;
+		job[i].sj_magic = (int)p_magic;
+	}
+
+	batch = 1;
+	while (lnum <= last)
+	{
+		if ((nblocks = search_batch(job, nthreads, blocks, batch, &lnum, last,
+														FORWARD, 's')) < 0)
+			break;
+		retval = OK;
+
+		for (i = 0; i < nblocks; ++i)
+		{
+			sb = &blocks[i];
+			first = sb->sb_first;
+
+			/*
+			 * When the new lines didn't fit, make sb_text bigger and do the
+			 * rest of the block here.
+			 */
+			while (sb->sb_stop != 0)
+			{
+				if ((p = alloc(sb->sb_tsize * 2)) == NULL)
+					goto theend;
+				memmove((char *)p, (char *)sb->sb_text, (size_t)sb->sb_tlen);
+				free(sb->sb_text);
+				sb->sb_text = p;
+				sb->sb_tsize *= 2;
+				sb->sb_first = sb->sb_stop;
+				sb->sb_stop = 0;
+				job[0].sj_blocks = sb;
+				job[0].sj_count = 1;
+				search_worker((void *)&job[0]);
+			}
+
+			/*
+			 * Save the changed lines for undo and put them in the buffer,
+			 * in line order.  A run of lines is put in with one call.
+			 */
+			p = sb->sb_text;
+			for (l = first; l <= sb->sb_last; ++l)
+			{
+				if (!sb->sb_match[l - sb->sb_low])
+					continue;
+				len = STRLEN(p) + 1;
+				if (count > 0 && (top + count != l
+											|| count == SEARCH_SUB_LINES))
+				{
+					ml_replace_lines(top, lines, (long)count);
+					count = 0;
+				}
+				if (u_savesub(l) == OK && (s = alloc(len)) != NULL)
+				{
+					memmove((char *)s, (char *)p, (size_t)len);
+					if (count == 0)
+						top = l;
+					lines[count++] = s;
+				}
+				p += len;
+				++*nlinesp;
+				*lastp = l;
+			}
+			*nsubsp += sb->sb_nsubs;
+		}
+
+		breakcheck();
+		if (got_int)
+			break;
+		if (batch < SEARCH_MAX_BATCH)
+			batch *= 2;
+	}
+
+theend:
+	if (count > 0)
+		ml_replace_lines(top, lines, (long)count);
+	search_end(job, nthreads, blocks);
+	return retval;
+}
+
+/*
+ * Make up to 'maxthreads' jobs for 'searchthreads' threads, each with a copy
+ * of 'prog' and work space for it.  Allocate room for the blocks of the
+ * largest batch in '*blocksp'.
+ * All memory is allocated here, not in the threads.
+ * Returns the number of threads, zero when threads can't be used.
+ */
+	static int
+search_start(job, maxthreads, prog, blocksp)
+	SEARCHJOB	*job;
+	int			maxthreads;
+	regexp		*prog;
+	SEARCHBLOCK	**blocksp;
+{
+	int			nthreads;
+	int			i;
+
+	nthreads = (p_sth > maxthreads ? maxthreads : (int)p_sth);
+	if (nthreads <= 1)
+		return 0;
+	*blocksp = (SEARCHBLOCK *)alloc((unsigned)(nthreads * SEARCH_MAX_BATCH *
+														sizeof(SEARCHBLOCK)));
+	if (*blocksp == NULL)
+		return 0;
+	memset((char *)*blocksp, 0, nthreads * SEARCH_MAX_BATCH * sizeof(SEARCHBLOCK));
+
+	/*
+	 * Each thread gets its own copy of the regexp, regexec_state() sets
+	 * startp[] and endp[].
+	 */
+	memset((char *)job, 0, nthreads * sizeof(SEARCHJOB));
+	for (i = 0; i < nthreads; ++i)
+	{
+		job[i].sj_prog = regdup(prog);
+		job[i].sj_state = regstate_new(prog);
+	}
+	for (i = 0; i < nthreads; ++i)
+		if (job[i].sj_prog == NULL || job[i].sj_state == NULL)
+		{
+			search_end(job, nthreads, *blocksp);
+			return 0;
+		}
+	return nthreads;
+}
+
+/*
+ * Copy up to 'nthreads' * 'batch' blocks from line '*lnump' to 'last' and let
+ * 'nthreads' threads match them.  '*lnump' is advanced to the line after the
+ * copied blocks.  'type' is NUL to find a match, 'g' to match all lines and
+ * 's' to substitute.
+ * Returns the number of blocks, -1 for failure.
+ */
+	static int
+search_batch(job, nthreads, blocks, batch, lnump, last, dir, type)
+	SEARCHJOB	*job;
+	int			nthreads;
+	SEARCHBLOCK	*blocks;
+	int			batch;
+	linenr_t	*lnump;
+	linenr_t	last;
+	int			dir;
+	int			type;
+{
+	pthread_t	thread[SEARCH_MAX_THREADS];
+	int			started[SEARCH_MAX_THREADS];
+	sigset_t	set, oldset;
+	SEARCHBLOCK	*sb;
+	linenr_t	lnum = *lnump;
+	linenr_t	high;
+	int			nblocks;
+	int			njobs;
+	int			per;
+	int			i;
+
+	/*
+	 * Copy the blocks for this batch.
+	 */
+	for (nblocks = 0; nblocks < nthreads * batch &&
+				(dir == FORWARD ? lnum <= last : lnum >= last); ++nblocks)
+	{
+		sb = &blocks[nblocks];
+		if (ml_copy_block(lnum, &sb->sb_data, &sb->sb_size, &sb->sb_low,
+																&high) == FAIL)
+			return -1;
+		sb->sb_first = lnum;
+		if (dir == FORWARD)
+			sb->sb_last = (high < last ? high : last);
+		else
+			sb->sb_last = (sb->sb_low > last ? sb->sb_low : last);
+		if (type != NUL && high - sb->sb_low + 1 > sb->sb_msize)
+		{
+			free(sb->sb_match);
+			sb->sb_msize = 0;
+			sb->sb_match = lalloc((long_u)(high - sb->sb_low + 1), TRUE);
+			if (sb->sb_match == NULL)
+				return -1;
+			sb->sb_msize = high - sb->sb_low + 1;
+		}
+		if (type == 's')
+		{
+			/* the text may get longer, the rest is done by the main thread */
+			if (sb->sb_tsize < sb->sb_size * 2)
+			{
+				free(sb->sb_text);
+				sb->sb_tsize = 0;
+				if ((sb->sb_text = alloc(sb->sb_size * 2)) == NULL)
+					return -1;
+				sb->sb_tsize = sb->sb_size * 2;
+			}
+			sb->sb_tlen = 0;
+			sb->sb_nsubs = 0;
+			sb->sb_stop = 0;
+		}
+		lnum = sb->sb_last + dir;
+	}
+	*lnump = lnum;
+
+	/*
+	 * Divide the blocks over the threads. Signals must be handled by the
+	 * main thread, the others block them all.
+	 */
+	per = (nblocks + nthreads - 1) / nthreads;
+	for (njobs = 0; njobs < nthreads; ++njobs)
+	{
+		job[njobs].sj_blocks = &blocks[njobs * per];
+		job[njobs].sj_count = nblocks - njobs * per;
+		if (job[njobs].sj_count > per)
+			job[njobs].sj_count = per;
+		else if (job[njobs].sj_count <= 0)
+			break;
+		job[njobs].sj_dir = dir;
+		job[njobs].sj_all = (type != NUL);
+	}
+	for (i = njobs; i < nthreads; ++i)
+		job[i].sj_count = 0;
+	sigfillset(&set);
+	pthread_sigmask(SIG_BLOCK, &set, &oldset);
+	for (i = 1; i < njobs; ++i)
+		started[i] = (pthread_create(&thread[i], NULL, search_worker,
+														(void *)&job[i]) == 0);
+	pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+	search_worker((void *)&job[0]);
+	for (i = 1; i < njobs; ++i)
+	{
+		if (started[i])
+			pthread_join(thread[i], NULL);
+		else
+			search_worker((void *)&job[i]);		/* do it ourselves */
+	}
+	return nblocks;
+}
+
+/*
+ * Free what search_start() allocated.
+ */
+	static void
+search_end(job, nthreads, blocks)
+	SEARCHJOB	*job;
+	int			nthreads;
+	SEARCHBLOCK	*blocks;
+{
+	int			i;
+
+	for (i = 0; i < nthreads * SEARCH_MAX_BATCH; ++i)
+	{
+		free(blocks[i].sb_data);
+		free(blocks[i].sb_match);
+		free(blocks[i].sb_text);
+	}
+	free(blocks);
+	for (i = 0; i < nthreads; ++i)
+	{
+		free(job[i].sj_prog);
+		regstate_free(job[i].sj_state);
+	}
+}
+
+/*
+ * Match the lines in the blocks of a SEARCHJOB. Runs in a thread, must not
+ * use global variables or allocate memory.
+ */
+	static void *
+search_worker(arg)
+	void		*arg;
+{
+	SEARCHJOB	*job = (SEARCHJOB *)arg;
+	SEARCHBLOCK	*sb;
+	linenr_t	lnum;
+	char_u		*line;
+	int			match;
+	int			i;
+
+	job->sj_found = 0;
+	for (i = 0; i < job->sj_count; ++i)
+	{
+		sb = &job->sj_blocks[i];
+		for (lnum = sb->sb_first; ; lnum += job->sj_dir)
+		{
+			line = ml_block_line(sb->sb_data, sb->sb_low, lnum);
+			match = regexec_state(job->sj_state, job->sj_prog, line, TRUE);
+			if (job->sj_all)
+				sb->sb_match[lnum - sb->sb_low] = (match != 0);
+			else if (match)
+			{
+				job->sj_found = lnum;
+				return NULL;
+			}
+			if (match && job->sj_sub != NULL && !sub_line(job, sb, line))
+			{
+				sb->sb_stop = lnum;		/* sb_text is full */
+				break;
+			}
+			if (lnum == sb->sb_last)
+				break;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Substitute in 'line', which matches, for sub_parallel().  Like dosub()
+ * without confirmation and line breaks.  The new line is appended to
+ * sb_text.  Runs in a thread.
+ * Returns FALSE when the new line doesn't fit in sb_text.
+ */
+	static int
+sub_line(job, sb, line)
+	SEARCHJOB	*job;
+	SEARCHBLOCK	*sb;
+	char_u		*line;
+{
+	regexp		*prog = job->sj_prog;
+	char_u		*old_match, *old_copy;
+	char_u		*prev_old_match = NULL;
+	char_u		*p, *p1, *p2;
+	unsigned	room;
+	unsigned	len;
+	long		nsubs = 0;
+
+	p = sb->sb_text + sb->sb_tlen;
+	room = sb->sb_tsize - sb->sb_tlen;
+	old_copy = old_match = line;
+	for (;;)
+	{
+		/*
+		 * Match empty string does not count, except for first match.
+		 */
+		if (old_match == prev_old_match && old_match == prog->endp[0])
+			++old_match;
+		else
+		{
+			old_match = prev_old_match = prog->endp[0];
+			len = prog->startp[0] - old_copy;
+			if (len + (unsigned)regsub(prog, job->sj_sub, line, FALSE,
+												job->sj_magic) > room)
+				return FALSE;
+			memmove((char *)p, (char *)old_copy, (size_t)len);
+			p += len;
+			regsub(prog, job->sj_sub, p, TRUE, job->sj_magic);
+
+			/* remove the CTRL-V that regsub() puts before a CR */
+			for (p1 = p2 = p; *p1 != NUL; ++p1)
+			{
+				if (*p1 == CR && p2 > p && p2[-1] == Ctrl('V'))
+					--p2;
+				*p2++ = *p1;
+			}
+			room -= len + (p2 - p);
+			p = p2;
+			old_copy = prog->endp[0];
+			++nsubs;
+		}
+		if (*old_match == NUL || !job->sj_global || !regexec_state(
+							job->sj_state, prog, old_match, FALSE))
+			break;
+	}
+
+	/* copy the rest of the line, that didn't match */
+	len = STRLEN(old_copy) + 1;
+	if (len > room)
+		return FALSE;
+	memmove((char *)p, (char *)old_copy, (size_t)len);
+	sb->sb_tlen = (p + len) - sb->sb_text;
+	sb->sb_nsubs += nsubs;
+	return TRUE;
+}
+#endif /* USE_PTHREAD */
+
 /*
  * Highest level string search function.
  * Search for the 'count'th occurence of string 'str' in direction 'dirc'
@@ -1636,28 +2210,26 @@ find_pattern_in_path(ptr, len, whole, skip_comments,
 	if (file_line == NULL)
 		return;
 
-	reg_ic = p_ic;
-	reg_magic = p_magic;
 	if (type != CHECK_PATH)
 	{
 		pat = alloc(len + 5);
 		if (pat == NULL)
 			goto fpip_end;
 		sprintf((char *)pat, whole ? "\\<%.*s\\>" : "%.*s", len, ptr);
-		prog = regcomp(pat);
+		prog = regcomp_cached(pat, p_magic, p_ic);
 		free(pat);
 		if (prog == NULL)
 			goto fpip_end;
 	}
 	if (p_inc != NULL && *p_inc != NUL)
 	{
-		include_prog = regcomp(p_inc);
+		include_prog = regcomp_cached(p_inc, p_magic, p_ic);
 		if (include_prog == NULL)
 			goto fpip_end;
 	}
 	if (type == FIND_DEFINE && p_def != NULL && *p_def != NUL)
 	{
-		define_prog = regcomp(p_def);
+		define_prog = regcomp_cached(p_def, p_magic, p_ic);
 		if (define_prog == NULL)
 			goto fpip_end;
 	}
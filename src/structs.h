@@ -89,6 +89,7 @@ struct u_entry
 	linenr_t		ue_lcount;	/* linecount when u_save called */
 	char_u			**ue_array;	/* array of lines in undo block */
 	long			ue_size;	/* number of lines in ue_array */
+	long			ue_space;	/* number of lines ue_array has room for */
 };
 
 struct u_header
@@ -160,44 +161,69 @@ typedef long				blocknr_t;
  *		the contents of the block in the file (if any) is irrelevant.
  */
 
+/*
+ * Hash tables are used to quickly find a block header and the translation of
+ * a negative block number.  Every item starts with an MF_HASHITEM, which
+ * holds the links of the hash list and the key (the block number).
+ *
+ * A table starts with MHT_INIT_SIZE buckets, using mht_small_buckets[], and
+ * doubles its size when the number of items gets bigger than the number of
+ * buckets.  Since block numbers are mostly consecutive, taking the lower bits
+ * spreads the items evenly and each hash list stays very short, also for a
+ * file with many thousands of blocks.
+ */
+typedef struct mf_hashitem	MF_HASHITEM;
+typedef struct mf_hashtab	MF_HASHTAB;
+
+struct mf_hashitem
+{
+	MF_HASHITEM	*mhi_next;			/* next item in hash list */
+	MF_HASHITEM	*mhi_prev;			/* previous item in hash list */
+	blocknr_t	mhi_key;			/* the key: block number */
+};
+
+#define MHT_INIT_SIZE	64			/* initial number of buckets, power of 2 */
+
+struct mf_hashtab
+{
+	long_u		mht_mask;			/* number of buckets - 1 */
+	long_u		mht_count;			/* number of items in the table */
+	MF_HASHITEM	**mht_buckets;		/* array of hash lists */
+	MF_HASHITEM	*mht_small_buckets[MHT_INIT_SIZE];	/* initial buckets */
+};
+
 struct block_hdr
 {
+	MF_HASHITEM	bh_hashitem;		/* hash list links and block number,
+									 * must be the first item! */
+#define bh_bnum bh_hashitem.mhi_key	/* block number */
 	BHDR		*bh_next;			/* next block_hdr in free or used list */
 	BHDR		*bh_prev;			/* previous block_hdr in used list */
-	BHDR		*bh_hash_next;		/* next block_hdr in hash list */
-	BHDR		*bh_hash_prev;		/* previous block_hdr in hash list */
-	blocknr_t	bh_bnum;				/* block number */
 	char_u		*bh_data;			/* pointer to memory (for used block) */
 	int			bh_page_count;		/* number of pages in this block */
 
 #define BH_DIRTY	1
 #define BH_LOCKED	2
-	char		bh_flags;			/* BH_DIRTY or BH_LOCKED */
+#define BH_PROTECT	4				/* in protected part of used list */
+	char		bh_flags;			/* BH_DIRTY, BH_LOCKED or BH_PROTECT */
 };
 
 /*
  * when a block with a negative number is flushed to the file, it gets
  * a positive number. Because the reference to the block is still the negative
  * number, we remember the translation to the new positive number in the
- * double linked trans lists. The structure is the same as the hash lists.
+ * trans hash table. The structure is the same as for the block headers.
  */
 typedef struct nr_trans NR_TRANS;
 
 struct nr_trans
 {
-	NR_TRANS	*nt_next;			/* next nr_trans in hash list */
-	NR_TRANS	*nt_prev;			/* previous nr_trans in hash list */
-	blocknr_t	nt_old_bnum;			/* old, negative, number */
+	MF_HASHITEM	nt_hashitem;		/* hash list links and old number,
+									 * must be the first item! */
+#define nt_old_bnum nt_hashitem.mhi_key	/* old, negative, number */
 	blocknr_t	nt_new_bnum;			/* new, positive, number */
 };
 
-/*
- * Simplistic hashing scheme to quickly locate the blocks in the used list.
- * 64 blocks are found directly (64 * 4K = 256K, most files are smaller).
- */
-#define MEMHASHSIZE		64
-#define MEMHASH(nr)		((nr) & (MEMHASHSIZE - 1))
-
 struct memfile
 {
 	char_u		*mf_fname;			/* name of the file */
@@ -206,16 +232,29 @@ struct memfile
 	BHDR		*mf_free_first;		/* first block_hdr in free list */
 	BHDR		*mf_used_first;		/* mru block_hdr in used list */
 	BHDR		*mf_used_last;		/* lru block_hdr in used list */
+	BHDR		*mf_used_probe;		/* first block_hdr in probation part */
 	unsigned	mf_used_count;		/* number of pages in used list */
+	unsigned	mf_prot_count;		/* number of pages in protected part */
 	unsigned	mf_used_count_max;	/* maximum number of pages in memory */
-	BHDR		*mf_hash[MEMHASHSIZE];	/* array of hash lists */
-	NR_TRANS	*mf_trans[MEMHASHSIZE];	/* array of trans lists */
+	MF_HASHTAB	mf_hash;			/* hash table for block headers */
+	MF_HASHTAB	mf_trans;			/* hash table for number translations */
 	blocknr_t	mf_blocknr_max;		/* highest positive block number + 1*/
 	blocknr_t	mf_blocknr_min;		/* lowest negative block number - 1 */
 	blocknr_t	mf_neg_count;		/* number of negative blocks numbers */
 	blocknr_t	mf_infile_count;	/* number of pages in the file */
 	unsigned	mf_page_size;		/* number of bytes in a page */
 	int			mf_dirty;			/* Set to TRUE if there are dirty blocks */
+	char_u		*mf_ra_buf;			/* read-ahead buffer or NULL */
+	blocknr_t	mf_ra_first;		/* first page in mf_ra_buf */
+	int			mf_ra_count;		/* number of pages in mf_ra_buf */
+	blocknr_t	mf_ra_next;			/* page after the last block read */
+	long		mf_nr_hit;			/* mf_get() found block in memory */
+	long		mf_nr_miss;			/* mf_get() had to read the block */
+	long		mf_nr_release;		/* blocks released by mf_release() */
+#ifdef USE_PTHREAD
+	int			mf_pending;			/* number of jobs for the writer thread */
+	int			mf_write_error;		/* the writer thread had a write error */
+#endif
 };
 
 /*
@@ -236,6 +275,21 @@ struct info_pointer
 	int			ip_index;		/* index for block with current lnum */
 };
 
+/*
+ * Recently used data blocks are remembered with the lines they contain, so
+ * that ml_find_line() can get the block for a line without walking down the
+ * tree.  An entry with mc_bnum zero is not used.
+ */
+typedef struct ml_cache_entry
+{
+	blocknr_t	mc_bnum;		/* data block number */
+	int			mc_page_count;	/* number of pages in the block */
+	linenr_t	mc_low;			/* first line in the block */
+	linenr_t	mc_high;		/* last line in the block */
+} MLCACHE;
+
+#define ML_CACHE_SIZE	16		/* number of entries in ml_cache */
+
 typedef struct memline MEMLINE;
 
 /*
@@ -264,6 +318,9 @@ struct memline
 	linenr_t	ml_locked_low;	/* first line in ml_locked */
 	linenr_t	ml_locked_high;	/* last line in ml_locked */
 	int			ml_locked_lineadd;	/* number of lines inserted in ml_locked */
+
+	MLCACHE		ml_cache[ML_CACHE_SIZE];	/* recently used data blocks */
+	int			ml_cache_next;	/* entry in ml_cache to be used next */
 };
 
 /*
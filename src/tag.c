@@ -15,8 +15,94 @@
 #include "proto.h"
 #include "param.h"
 
+#ifdef USE_MMAP
+# include <sys/mman.h>
+# ifndef MAP_FAILED
+#  define MAP_FAILED	((char *)-1)
+# endif
+#endif
+
 static int findtag __ARGS((char_u *));
 static int get_tagfname __ARGS((int, char_u	*));
+static int tag_file_sorted __ARGS((FILE *, char_u *));
+static int tag_compare __ARGS((char_u *, char_u *, int, int));
+static void tag_bsearch __ARGS((FILE *, char_u *, int, int, char_u *));
+static int tag_static_key __ARGS((int, char_u *, char_u *));
+
+/*
+ * An index for a tags file that can't be searched with a binary search.  The
+ * offset of each line is kept with a hash of the tag name, lines with the
+ * same hash are linked in file order.  The tag name is hashed with case
+ * folded, thus the index can be used with and without 'ignorecase'.  The
+ * lines found with it are checked like when reading the file.
+ * The index is used as long as the size and time of the file don't change.
+ */
+typedef struct tagentry
+{
+	long		te_offset;		/* file offset of the line */
+	unsigned	te_hash;		/* hash of the tag name */
+	long		te_next;		/* next entry in the same bucket or -1 */
+} TAGENTRY;
+
+typedef struct tagindex TAGINDEX;
+struct tagindex
+{
+	TAGINDEX	*ti_next;		/* next index in the list */
+	char_u		*ti_fname;		/* full name of the tags file */
+	time_t		ti_mtime;		/* time of the tags file */
+	long		ti_size;		/* size of the tags file */
+	TAGENTRY	*ti_entries;	/* one entry for each tag name */
+	long		ti_count;		/* number of used entries */
+	long		*ti_buckets;	/* first entry for a hash value or -1 */
+	unsigned	ti_mask;		/* number of buckets - 1 */
+};
+
+static TAGINDEX *first_tagindex = NULL;
+
+static unsigned tag_hash __ARGS((char_u *, char_u *));
+static void tag_index_free __ARGS((TAGINDEX *));
+static TAGINDEX *tag_index_find __ARGS((char_u *));
+static TAGINDEX *tag_index_build __ARGS((char_u *, FILE *, char_u *));
+static int tag_index_line __ARGS((TAGINDEX *, char_u *, char_u *, long, long *));
+static int tag_index_add __ARGS((TAGINDEX *, char_u *, char_u *, long, long *));
+static long tag_index_next __ARGS((TAGINDEX *, long, unsigned));
+
+/*
+ * Cache for the line where the search command of a tag matched, so that
+ * jumping to the same tag again doesn't search through the file. Only a
+ * pattern that matches once in the file is cached, then the search would find
+ * the same line from any cursor position. An entry is used when the time of
+ * the file didn't change, the buffer was not changed and the pattern still
+ * matches in that line. A search command with an offset is not cached.
+ */
+#define TAG_CACHE_SIZE	20
+
+static struct tagcache
+{
+	char_u		*tc_fname;		/* file name, NULL for unused entry */
+	char_u		*tc_pat;		/* search command, starts with '/' or '?' */
+	time_t		tc_mtime;		/* time of the file */
+	linenr_t	tc_lnum;		/* line where the pattern matched */
+	int			tc_ic;			/* value of 'ignorecase' */
+	int			tc_magic;		/* value of 'magic' */
+} tag_cache[TAG_CACHE_SIZE];
+
+static int tag_cache_next = 0;	/* index of entry to be used next */
+
+static struct tagcache *tag_cache_find __ARGS((char_u *, struct stat *));
+static int tag_cache_jump __ARGS((char_u *));
+static void tag_cache_add __ARGS((char_u *));
+
+#ifdef USE_MMAP
+/*
+ * With USE_MMAP a tags file that has to be read completely is mapped into
+ * memory. The lines are found with memchr() and only a line that may match
+ * is copied into the line buffer.
+ */
+static char_u *tag_map __ARGS((FILE *, long *));
+static int tag_map_next __ARGS((char_u *, long, long *, char_u *, int, char_u *));
+static int tag_map_match __ARGS((char_u *, char_u *, char_u *, int));
+#endif
 static char_u *bottommsg = (char_u *)"at bottom of tag stack";
 static char_u *topmsg = (char_u *)"at top of tag stack";
 
@@ -210,6 +296,18 @@ findtag(tag)
 	int			retval = FAIL;
 	int			is_static;				/* current tag line is static */
 	int			eof;					/* end of tags file */
+	int			sorted;					/* tags file is sorted */
+	char_u		*skey = NULL;			/* key of lines read in sorted file */
+	int			skeylen = 0;			/* length of "skey" to compare */
+	int			skeynr = 0;				/* 0: tag, 1 and 2: "file:tag" */
+	TAGINDEX	*ti;					/* index for tags file */
+	long		te = -1;				/* next entry in "ti" */
+	unsigned	hash = 0;				/* hash of "tag" */
+#ifdef USE_MMAP
+	char_u		*map = NULL;			/* mapped tags file */
+	long		map_size = 0;
+	long		map_pos = 0;			/* offset of next line in "map" */
+#endif
 	char_u		*static_line = NULL;	/* saved line for static tag */
 	char_u		*global_line = NULL;	/* saved line for global tag */
 	int			first_file;				/* trying first tag file */
@@ -230,12 +328,107 @@ findtag(tag)
 	for (first_file = TRUE; get_tagfname(first_file, tag_fname) == OK;
 															first_file = FALSE)
 	{
+		/*
+		 * When there is an index for the file, only the lines for the tag
+		 * are read. When the tag is not in the index the file is not opened.
+		 */
+		sorted = 0;
+		ti = NULL;
+		if (p_tl == 0 && (ti = tag_index_find(tag_fname)) != NULL)
+		{
+			hash = tag_hash(tag, NULL);
+			te = tag_index_next(ti, -1L, hash);
+			if (te < 0)
+			{
+				m = NULL;
+				continue;
+			}
+		}
+
 		if ((fp = fopen((char *)tag_fname, "r")) == NULL)
 			continue;
-		reg_ic = p_ic;										/* for cstrncmp() */
+
+		/*
+		 * In a sorted tags file the lines for the tag are found with a binary
+		 * search. When the file is sorted on case but case is ignored, the
+		 * whole file has to be read, and an index is made for the next time.
+		 */
+		if (ti == NULL)
+		{
+			sorted = tag_file_sorted(fp, lbuf);
+			if ((sorted == 1 && p_ic) || sorted > 2)
+				sorted = 0;
+			if (sorted)
+			{
+				skey = tag;
+				skeylen = cmplen;
+				skeynr = 0;
+				tag_bsearch(fp, skey, skeylen, sorted == 2, lbuf);
+			}
+			else if (p_tl == 0 &&
+						(ti = tag_index_build(tag_fname, fp, lbuf)) != NULL)
+			{
+				hash = tag_hash(tag, NULL);
+				te = tag_index_next(ti, -1L, hash);
+			}
+			else
+			{
+#ifdef USE_MMAP
+				map = tag_map(fp, &map_size);
+				map_pos = 0;
+#endif
+				fseek(fp, 0L, SEEK_SET);
+			}
+		}
+
 		for (;;)
 		{
-			eof = (fgets((char *)lbuf, LSIZE, fp) == NULL);
+			if (ti != NULL)			/* read the next line from the index */
+			{
+				eof = (te < 0 || fseek(fp, ti->ti_entries[te].te_offset,
+															SEEK_SET) != 0 ||
+							fgets((char *)lbuf, LSIZE, fp) == NULL);
+				if (!eof)
+					te = tag_index_next(ti, te, hash);
+			}
+#ifdef USE_MMAP
+			else if (map != NULL)
+				eof = !tag_map_next(map, map_size, &map_pos, tag, cmplen, lbuf);
+#endif
+			else
+				eof = (fgets((char *)lbuf, LSIZE, fp) == NULL);
+				/* in a sorted file the matching lines are together */
+			if (!eof && sorted && tag_compare(lbuf, skey, skeylen, sorted == 2) > 0)
+				eof = TRUE;
+			if (eof && sorted)
+			{
+				/*
+				 * Old style static tags "file:tag" are sorted under the file
+				 * name, search for the ones of the current file.  When
+				 * nothing was found read the whole file, there may be static
+				 * tags for other files.
+				 */
+				while (++skeynr <= 2 &&
+								(i = tag_static_key(skeynr, tag, pbuf)) < 0)
+					;
+				if (skeynr <= 2)
+				{
+					skey = pbuf;
+					skeylen = i + 1 + cmplen;
+					tag_bsearch(fp, skey, skeylen, sorted == 2, lbuf);
+					continue;
+				}
+				if (global_line == NULL && static_line == NULL)
+				{
+					sorted = 0;
+#ifdef USE_MMAP
+					map = tag_map(fp, &map_size);
+					map_pos = 0;
+#endif
+					fseek(fp, 0L, SEEK_SET);
+					continue;
+				}
+			}
 			if (eof)
 			{
 				if (global_line != NULL)
@@ -276,7 +469,7 @@ findtag(tag)
 			for (p = tagname; *p; ++p)
 			{
 				if (*p == ':' && p > tagname &&
-								cstrncmp(tagname, fname, p - tagname) == 0)
+								cstrncmp(tagname, fname, p - tagname, p_ic) == 0)
 				{
 					*p = '\0';
 					is_static = TRUE;
@@ -285,7 +478,7 @@ findtag(tag)
 				}
 			}
 
-			if (cstrncmp(tagname, tag, cmplen) == 0)		/* Tag matches */
+			if (cstrncmp(tagname, tag, cmplen, p_ic) == 0)		/* Tag matches */
 			{
 				if (!eof)
 				{
@@ -320,6 +513,12 @@ findtag(tag)
 
 				/* When we get here we have a match, close the file */
 				fclose(fp);
+				fp = NULL;
+#ifdef USE_MMAP
+				if (map != NULL)
+					munmap((char *)map, (size_t)map_size);
+				map = NULL;
+#endif
 
 				/*
 				 * If the command is a string like "/^function fname"
@@ -435,7 +634,9 @@ findtag(tag)
 					{
 						save_p_ws = p_ws;
 						p_ws = TRUE;	/* Switch wrap-scan on temporarily */
-						if (!dosearch(pbuf[0], pbuf + 1,
+						if (tag_cache_jump(pbuf) == OK)
+							;
+						else if (!dosearch(pbuf[0], pbuf + 1,
 												FALSE, (long)1, FALSE, FALSE))
 						{
 							register int notfound = FALSE;
@@ -462,6 +663,8 @@ findtag(tag)
 								sleep(1);
 							}
 						}
+						else
+							tag_cache_add(pbuf);
 						p_ws = save_p_ws;
 					}
 					else
@@ -496,7 +699,13 @@ findtag(tag)
 		m = NULL;
 
 erret:
-		fclose(fp);
+		if (fp != NULL)
+			fclose(fp);
+#ifdef USE_MMAP
+		if (map != NULL)
+			munmap((char *)map, (size_t)map_size);
+		map = NULL;
+#endif
 		if (m)
 			emsg2(m, marg);
 	}
@@ -514,6 +723,613 @@ findtag_end:
 	return retval;
 }
 
+/*
+ * Check the header lines of a tags file for "!_TAG_FILE_SORTED".
+ * Return 0 for an unsorted file, 1 for a sorted file, 2 for a file sorted
+ * with case folded.
+ */
+	static int
+tag_file_sorted(fp, lbuf)
+	FILE	*fp;
+	char_u	*lbuf;
+{
+	while (fgets((char *)lbuf, LSIZE, fp) != NULL &&
+									STRNCMP(lbuf, "!_TAG_", 6) == 0)
+		if (STRNCMP(lbuf, "!_TAG_FILE_SORTED\t", 18) == 0)
+			return atoi((char *)lbuf + 18);
+	return 0;
+}
+
+/*
+ * Compare the tag name at the start of tags file line 'line' with 'tag', in
+ * the order used for sorting tags files. Only the first 'cmplen' characters
+ * are used. When 'fold' is TRUE case is ignored.
+ * Return < 0 when the tag in the line comes before 'tag', 0 when it matches,
+ * > 0 when it comes after 'tag'.
+ */
+	static int
+tag_compare(line, tag, cmplen, fold)
+	char_u	*line;
+	char_u	*tag;
+	int		cmplen;
+	int		fold;
+{
+	int		c1, c2;
+
+	for ( ; cmplen > 0; --cmplen, ++line, ++tag)
+	{
+		c1 = *line;
+		if (c1 == ' ' || c1 == TAB || c1 == '\n' || c1 == '\r')
+			c1 = NUL;
+		c2 = *tag;
+		if (fold)
+		{
+			c1 = TO_UPPER(c1);
+			c2 = TO_UPPER(c2);
+		}
+		if (c1 != c2)
+			return c1 - c2;
+		if (c1 == NUL)
+			break;
+	}
+	return 0;
+}
+
+/*
+ * Binary search in a sorted tags file: position 'fp' at the first line with a
+ * tag that does not come before 'tag'. 'lbuf' is used to read lines.
+ */
+	static void
+tag_bsearch(fp, tag, cmplen, fold, lbuf)
+	FILE	*fp;
+	char_u	*tag;
+	int		cmplen;
+	int		fold;
+	char_u	*lbuf;
+{
+	long	lo, hi, mid, off;
+	int		c;
+
+	/*
+	 * "lo" and "hi" are at the start of a line or at the end of the file.
+	 * The lines before "lo" come before the tag, the line at "hi" doesn't.
+	 */
+	fseek(fp, 0L, SEEK_END);
+	hi = ftell(fp);
+	lo = 0;
+	while (lo < hi)
+	{
+		mid = lo + (hi - lo) / 2;
+		off = lo;
+		if (mid > lo)
+		{
+				/* find the start of the line at or after "mid" */
+			fseek(fp, mid - 1, SEEK_SET);
+			while ((c = getc(fp)) != EOF && c != '\n')
+				;
+			off = ftell(fp);
+			if (off >= hi)			/* no line starts between mid and hi */
+				off = lo;
+		}
+		fseek(fp, off, SEEK_SET);
+		if (fgets((char *)lbuf, LSIZE, fp) == NULL)
+			break;
+		if (STRCHR(lbuf, '\n') == NULL)		/* skip rest of long line */
+			while ((c = getc(fp)) != EOF && c != '\n')
+				;
+		if (tag_compare(lbuf, tag, cmplen, fold) >= 0)
+			hi = off;
+		else
+			lo = ftell(fp);
+	}
+	fseek(fp, lo, SEEK_SET);
+}
+
+/*
+ * Put the key for old style static tags of the current file, "file:tag", in
+ * 'buf'. For 'nr' 1 the tail of the file name is used, for 'nr' 2 the name as
+ * it was typed, when it is different.
+ * Return the length of the file name, -1 when there is no key.
+ */
+	static int
+tag_static_key(nr, tag, buf)
+	int		nr;
+	char_u	*tag;
+	char_u	*buf;
+{
+	char_u	*name;
+	int		len;
+
+	if (curbuf->b_filename == NULL)
+		return -1;
+	name = gettail(curbuf->b_filename);
+	if (nr == 2)
+	{
+		if (curbuf->b_sfilename == NULL || STRCMP(curbuf->b_sfilename, name) == 0)
+			return -1;
+		name = curbuf->b_sfilename;
+	}
+	len = STRLEN(name);
+	if (len + STRLEN(tag) + 2 > LSIZE)
+		return -1;
+	sprintf((char *)buf, "%s:%s", (char *)name, (char *)tag);
+	return len;
+}
+
+/*
+ * Compute the hash value for a tag name, ending at white space or at 'end'
+ * (NULL for a NUL terminated string).
+ */
+	static unsigned
+tag_hash(p, end)
+	char_u	*p;
+	char_u	*end;
+{
+	unsigned	hash = 0;
+
+	while (p != end && *p != NUL && *p != ' ' && *p != TAB && *p != '\n'
+																&& *p != '\r')
+	{
+		hash = hash * 33 + TO_UPPER(*p);
+		++p;
+	}
+	return hash;
+}
+
+	static void
+tag_index_free(ti)
+	TAGINDEX	*ti;
+{
+	free(ti->ti_fname);
+	if (ti->ti_entries != NULL)
+		free(ti->ti_entries);
+	if (ti->ti_buckets != NULL)
+		free(ti->ti_buckets);
+	free(ti);
+}
+
+/*
+ * Find the index for tags file 'fname'.
+ * An index for a file that was changed or deleted is freed.
+ * Return NULL when there is no valid index.
+ */
+	static TAGINDEX *
+tag_index_find(fname)
+	char_u	*fname;
+{
+	TAGINDEX	*ti, **tip;
+	struct stat	st;
+
+	if (FullName(fname, NameBuff, MAXPATHL) == FAIL)
+		return NULL;
+	for (tip = &first_tagindex; (ti = *tip) != NULL; tip = &ti->ti_next)
+		if (STRCMP(ti->ti_fname, NameBuff) == 0)
+		{
+			if (stat((char *)fname, &st) == 0 && st.st_mtime == ti->ti_mtime
+											&& (long)st.st_size == ti->ti_size)
+				return ti;
+			*tip = ti->ti_next;
+			tag_index_free(ti);
+			break;
+		}
+	return NULL;
+}
+
+/*
+ * Make an index for tags file 'fname', opened as 'fp'. 'lbuf' is used to read
+ * lines.
+ * Return NULL when out of memory.
+ */
+	static TAGINDEX *
+tag_index_build(fname, fp, lbuf)
+	char_u	*fname;
+	FILE	*fp;
+	char_u	*lbuf;
+{
+	TAGINDEX	*ti;
+	struct stat	st;
+	long		size = 0;
+	long		offset;
+	long		i;
+	unsigned	n;
+#ifdef USE_MMAP
+	char_u		*map;
+	long		map_size;
+	char_u		*p, *next, *end;
+#endif
+
+	if (FullName(fname, NameBuff, MAXPATHL) == FAIL ||
+										fstat(fileno(fp), &st) < 0 ||
+					(ti = (TAGINDEX *)alloc((unsigned)sizeof(TAGINDEX))) == NULL)
+		return NULL;
+	ti->ti_fname = strsave(NameBuff);
+	ti->ti_mtime = st.st_mtime;
+	ti->ti_size = (long)st.st_size;
+	ti->ti_entries = NULL;
+	ti->ti_count = 0;
+	ti->ti_buckets = NULL;
+	if (ti->ti_fname == NULL)
+		goto fail;
+
+#ifdef USE_MMAP
+	if ((map = tag_map(fp, &map_size)) != NULL)
+	{
+		for (p = map, end = map + map_size; p < end; p = next)
+		{
+			next = (char_u *)memchr((char *)p, '\n', (size_t)(end - p));
+			next = (next == NULL) ? end : next + 1;
+			if (tag_index_line(ti, p, next, (long)(p - map), &size) == FAIL)
+			{
+				munmap((char *)map, (size_t)map_size);
+				goto fail;
+			}
+		}
+		munmap((char *)map, (size_t)map_size);
+	}
+	else
+#endif
+	{
+		fseek(fp, 0L, SEEK_SET);
+		for (;;)
+		{
+			offset = ftell(fp);
+			if (fgets((char *)lbuf, LSIZE, fp) == NULL)
+				break;
+			if (tag_index_line(ti, lbuf, lbuf + STRLEN(lbuf), offset, &size)
+																	== FAIL)
+				goto fail;
+		}
+	}
+
+	/*
+	 * Link the entries in the buckets, in file order.
+	 */
+	for (n = 1; n < (unsigned)ti->ti_count; n <<= 1)
+		;
+	ti->ti_mask = n - 1;
+	ti->ti_buckets = (long *)lalloc((long_u)(n * sizeof(long)), TRUE);
+	if (ti->ti_buckets == NULL)
+		goto fail;
+	for (i = 0; i < (long)n; ++i)
+		ti->ti_buckets[i] = -1;
+	for (i = ti->ti_count; --i >= 0; )
+	{
+		n = ti->ti_entries[i].te_hash & ti->ti_mask;
+		ti->ti_entries[i].te_next = ti->ti_buckets[n];
+		ti->ti_buckets[n] = i;
+	}
+
+	ti->ti_next = first_tagindex;
+	first_tagindex = ti;
+	return ti;
+
+fail:
+	tag_index_free(ti);
+	return NULL;
+}
+
+/*
+ * Add the line from 'line' to 'end', at 'offset' in the tags file, to index
+ * 'ti'. '*sizep' is the number of allocated entries.
+ */
+	static int
+tag_index_line(ti, line, end, offset, sizep)
+	TAGINDEX	*ti;
+	char_u		*line;
+	char_u		*end;
+	long		offset;
+	long		*sizep;
+{
+	char_u		*p, *tagname, *fend;
+
+	if (tag_index_add(ti, line, end, offset, sizep) == FAIL)
+		return FAIL;
+
+	/*
+	 * A static tag "file:tag" is also added for the part after the colon.
+	 * Case is ignored here, findtag() checks the line again.
+	 */
+	for (fend = line; fend < end && *fend != NUL && !iswhite(*fend); ++fend)
+		;
+	if (fend == end || *fend == NUL)
+		return OK;
+	for (p = fend; p < end && iswhite(*p); ++p)
+		;
+	for (tagname = line + 1; tagname < fend; ++tagname)
+		if (*tagname == ':' && end - p >= tagname - line &&
+						vim_strnicmp(line, p, (size_t)(tagname - line)) == 0 &&
+						tag_index_add(ti, tagname + 1, end, offset, sizep) == FAIL)
+			return FAIL;
+	return OK;
+}
+
+/*
+ * Add an entry for the tag name at 'tagname', in the line that ends at 'end'
+ * and is at 'offset' in the tags file, to index 'ti'. '*sizep' is the number
+ * of allocated entries.
+ */
+	static int
+tag_index_add(ti, tagname, end, offset, sizep)
+	TAGINDEX	*ti;
+	char_u		*tagname;
+	char_u		*end;
+	long		offset;
+	long		*sizep;
+{
+	TAGENTRY	*te;
+
+	if (ti->ti_count == *sizep)
+	{
+		te = (TAGENTRY *)lalloc((long_u)(sizeof(TAGENTRY) *
+							(*sizep == 0 ? 1000 : *sizep * 2)), TRUE);
+		if (te == NULL)
+			return FAIL;
+		if (ti->ti_entries != NULL)
+		{
+			memmove((char *)te, (char *)ti->ti_entries,
+								(size_t)ti->ti_count * sizeof(TAGENTRY));
+			free(ti->ti_entries);
+		}
+		ti->ti_entries = te;
+		*sizep = (*sizep == 0 ? 1000 : *sizep * 2);
+	}
+	te = &ti->ti_entries[ti->ti_count++];
+	te->te_offset = offset;
+	te->te_hash = tag_hash(tagname, end);
+	return OK;
+}
+
+/*
+ * Return the entry in index 'ti' after entry 'te' with hash 'hash', the first
+ * one when 'te' is -1. Return -1 when there is none.
+ */
+	static long
+tag_index_next(ti, te, hash)
+	TAGINDEX	*ti;
+	long		te;
+	unsigned	hash;
+{
+	if (te < 0)
+		te = ti->ti_buckets[hash & ti->ti_mask];
+	else
+		te = ti->ti_entries[te].te_next;
+	while (te >= 0 && ti->ti_entries[te].te_hash != hash)
+		te = ti->ti_entries[te].te_next;
+	return te;
+}
+
+#ifdef USE_MMAP
+/*
+ * Map the tags file 'fp' into memory, its size is put in '*sizep'.
+ * Return NULL when this fails, the file has to be read then.
+ */
+	static char_u *
+tag_map(fp, sizep)
+	FILE	*fp;
+	long	*sizep;
+{
+	struct stat	st;
+	char_u		*map;
+
+	if (fstat(fileno(fp), &st) < 0 || st.st_size <= 0)
+		return NULL;
+	*sizep = (long)st.st_size;
+	map = (char_u *)mmap(NULL, (size_t)*sizep, PROT_READ, MAP_PRIVATE,
+													fileno(fp), (off_t)0);
+	if ((char *)map == MAP_FAILED || *sizep != st.st_size)
+		return NULL;
+	return map;
+}
+
+/*
+ * Find the next line in mapped tags file 'map', starting at offset '*posp',
+ * that may match 'tag'. It is copied into 'lbuf' like fgets() does and
+ * '*posp' is set to the line after it.
+ * Return FALSE when there are no more lines that may match.
+ */
+	static int
+tag_map_next(map, size, posp, tag, cmplen, lbuf)
+	char_u	*map;
+	long	size;
+	long	*posp;
+	char_u	*tag;
+	int		cmplen;
+	char_u	*lbuf;
+{
+	char_u	*p, *next, *end;
+	char_u	*s;
+	int		len;
+
+	end = map + size;
+	for (p = map + *posp; p < end; p = next)
+	{
+		next = (char_u *)memchr((char *)p, '\n', (size_t)(end - p));
+		next = (next == NULL) ? end : next + 1;
+
+		/*
+		 * The tag may be at the start of the line or, for a static tag
+		 * "file:tag", after a colon in the first field.
+		 */
+		if (!tag_map_match(p, next, tag, cmplen))
+		{
+			for (s = p + 1; s < next && *s != NUL && !iswhite(*s); ++s)
+				if (*s == ':' && tag_map_match(s + 1, next, tag, cmplen))
+					break;
+			if (s == next || *s != ':')
+				continue;
+		}
+
+		len = next - p;
+		if (len > LSIZE - 1)
+			len = LSIZE - 1;
+		memmove((char *)lbuf, (char *)p, (size_t)len);
+		lbuf[len] = NUL;
+		*posp = next - map;
+		return TRUE;
+	}
+	*posp = size;
+	return FALSE;
+}
+
+/*
+ * Return TRUE when the tag name at 'p', in a line ending at 'end', matches
+ * 'tag' in its first 'cmplen' characters, ignoring case when 'ignorecase' is
+ * set.
+ */
+	static int
+tag_map_match(p, end, tag, cmplen)
+	char_u	*p;
+	char_u	*end;
+	char_u	*tag;
+	int		cmplen;
+{
+	int		n;
+
+	n = STRLEN(tag) + 1;			/* also compare the end of the name */
+	if (n > cmplen)
+		n = cmplen;
+	if (end - p < n)
+		return FALSE;
+	return (tag_compare(p, tag, n, (int)p_ic) == 0);
+}
+#endif
+
+/*
+ * Find the tag cache entry for search command 'pat' in the current file. The
+ * time of the file is put in '*stp'.
+ * Return NULL when there is none, or when the command can't be cached.
+ */
+	static struct tagcache *
+tag_cache_find(pat, stp)
+	char_u		*pat;
+	struct stat	*stp;
+{
+	int			i;
+	char_u		*p;
+
+	p = skip_regexp(pat + 1, pat[0]);	/* find the closing delimiter */
+	if (curbuf->b_filename == NULL || curbuf->b_changed ||
+							(p[0] != NUL && p[1] != NUL) ||
+							stat((char *)curbuf->b_filename, stp) < 0)
+		return NULL;
+	for (i = 0; i < TAG_CACHE_SIZE; ++i)
+		if (tag_cache[i].tc_fname != NULL &&
+							STRCMP(tag_cache[i].tc_pat, pat) == 0 &&
+							STRCMP(tag_cache[i].tc_fname, curbuf->b_filename) == 0)
+			return &tag_cache[i];
+	return NULL;
+}
+
+/*
+ * Move the cursor to the match of search command 'pat' in the current file,
+ * using the line remembered in the tag cache.
+ * Return FAIL when not found, a normal search has to be done.
+ */
+	static int
+tag_cache_jump(pat)
+	char_u		*pat;
+{
+	struct tagcache	*tc;
+	struct stat		st;
+	regexp			*prog;
+	char_u			*line;
+	char_u			*dircp;
+	int				retval = FAIL;
+
+	if ((tc = tag_cache_find(pat, &st)) == NULL ||
+							tc->tc_mtime != st.st_mtime ||
+							tc->tc_ic != p_ic || tc->tc_magic != p_magic ||
+							tc->tc_lnum > curbuf->b_ml.ml_line_count)
+		return FAIL;
+	dircp = skip_regexp(pat + 1, pat[0]);
+	if (*dircp != NUL)				/* toss the closing delimiter */
+		*dircp = NUL;
+	else
+		dircp = NULL;
+	prog = myregcomp(pat + 1, 0, 2);
+	if (dircp != NULL)
+		*dircp = pat[0];
+	if (prog == NULL)
+		return FAIL;
+	line = ml_get(tc->tc_lnum);
+	if (pat[0] == '/' ? regexec(prog, line, TRUE)
+					  : regexec_last(prog, line, TRUE, NULL))
+	{
+		curwin->w_cursor.lnum = tc->tc_lnum;
+		curwin->w_cursor.col = prog->startp[0] - line;
+		curwin->w_set_curswant = TRUE;
+		retval = OK;
+	}
+	free(prog);
+	return retval;
+}
+
+/*
+ * Remember the cursor line as the match of search command 'pat' in the
+ * current file, if there is no other match.
+ */
+	static void
+tag_cache_add(pat)
+	char_u		*pat;
+{
+	struct tagcache	*tc;
+	struct stat		st;
+	FPOS			pos;
+	char_u			*dircp;
+	int				found;
+
+	dircp = skip_regexp(pat + 1, pat[0]);	/* find the closing delimiter */
+	if ((tc = tag_cache_find(pat, &st)) == NULL)
+	{
+		if (curbuf->b_filename == NULL || curbuf->b_changed ||
+							(dircp[0] != NUL && dircp[1] != NUL) ||
+							stat((char *)curbuf->b_filename, &st) < 0)
+			return;
+		tc = &tag_cache[tag_cache_next];
+		tag_cache_next = (tag_cache_next + 1) % TAG_CACHE_SIZE;
+		if (tc->tc_fname != NULL)
+		{
+			free(tc->tc_fname);
+			free(tc->tc_pat);
+		}
+		tc->tc_fname = strsave(curbuf->b_filename);
+		tc->tc_pat = strsave(pat);
+		if (tc->tc_fname == NULL || tc->tc_pat == NULL)
+			goto drop;
+	}
+
+	/*
+	 * Searching again from the match must wrap around to the same match.
+	 */
+	pos = curwin->w_cursor;
+	if (*dircp != NUL)				/* toss the closing delimiter */
+		*dircp = NUL;
+	else
+		dircp = NULL;
+	found = searchit(&pos, pat[0] == '/' ? FORWARD : BACKWARD, pat + 1, 1L,
+												FALSE, FALSE, 2);
+	if (dircp != NULL)
+		*dircp = pat[0];
+	if (found == FAIL ||
+						pos.lnum != curwin->w_cursor.lnum ||
+						pos.col != curwin->w_cursor.col)
+		goto drop;
+
+	tc->tc_mtime = st.st_mtime;
+	tc->tc_lnum = curwin->w_cursor.lnum;
+	tc->tc_ic = p_ic;
+	tc->tc_magic = p_magic;
+	return;
+
+drop:
+	if (tc->tc_fname != NULL)
+		free(tc->tc_fname);
+	if (tc->tc_pat != NULL)
+		free(tc->tc_pat);
+	tc->tc_fname = NULL;
+	tc->tc_pat = NULL;
+}
+
 /*
  * Get the next name of a tag file from the tag file list.
  * Also try the tag file in the same directory as the current file.
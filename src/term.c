@@ -1242,6 +1242,16 @@ inchar(buf, maxlen, wait_time)
 			while (GetChars(buf, maxlen, T_PEEK))
 				;
 			return retesc;
+		}
+			/* read a file lazily until a character is typed */
+		if (wait_time == -1)
+		{
+			while (readfile_pending() && !mch_char_avail())
+				readfile_more();
+				/* parse the rest of the errorfile, not at --more-- */
+			if (State & NORMAL)
+				while (qf_pending() && !mch_char_avail())
+					qf_more();
 		}
 			/* fill up to half the buffer, because each character may be
 			 * doubled below */
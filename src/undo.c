@@ -51,6 +51,7 @@
 
 static void u_getbot __ARGS((void));
 static int u_savecommon __ARGS((linenr_t, linenr_t, linenr_t));
+static int u_extend __ARGS((linenr_t, linenr_t, linenr_t));
 static void u_undoredo __ARGS((void));
 static void u_undo_end __ARGS((void));
 static void u_freelist __ARGS((struct u_header *));
@@ -192,7 +193,14 @@ u_savecommon(top, bot, newbot)
 		++curbuf->b_u_numhead;
 	}
 	else	/* find line number for ue_bot for previous u_save() */
+	{
 		u_getbot();
+		if (newbot && u_extend(top, bot, newbot))
+		{
+			curbuf->b_u_synced = FALSE;
+			return OK;
+		}
+	}
 
 	size = bot - top - 1;
 #ifndef UNIX
@@ -212,6 +220,7 @@ u_savecommon(top, bot, newbot)
 		goto nomem;
 
 	uep->ue_size = size;
+	uep->ue_space = size;
 	uep->ue_top = top;
 	uep->ue_lcount = 0;
 	if (newbot)
@@ -256,6 +265,62 @@ nomem:
 	return FAIL;
 }
 
+/*
+ * Add the lines between "top" and "bot" to the newest entry when they are just
+ * below the lines of that entry, so that ":s" on many lines makes one entry.
+ * The array of the entry grows to twice its size when it is full.
+ * Returns FALSE when a new entry must be made.
+ */
+	static int
+u_extend(top, bot, newbot)
+	linenr_t top, bot;
+	linenr_t newbot;
+{
+	struct u_entry	*uep;
+	char_u			**array;
+	long			size;
+	long			space;
+	long			i;
+
+	uep = curbuf->b_u_newhead->uh_entry;
+	if (uep == NULL || uep->ue_bot != top + 1)
+		return FALSE;
+
+	size = bot - top - 1;
+	if (uep->ue_size + size > uep->ue_space)
+	{
+		space = uep->ue_space * 2;
+		if (space < uep->ue_size + size)
+			space = uep->ue_size + size;
+#ifndef UNIX
+		if (space >= 8000)		/* see u_savecommon() */
+			return FALSE;
+#endif
+		if ((array = (char_u **)u_alloc_line((unsigned)(sizeof(char_u *) * space))) == NULL)
+			return FALSE;
+		if (uep->ue_size)
+		{
+			memmove((char *)array, (char *)uep->ue_array,
+										sizeof(char_u *) * uep->ue_size);
+			u_free_line((char_u *)uep->ue_array);
+		}
+		uep->ue_array = array;
+		uep->ue_space = space;
+	}
+	for (i = 0; i < size; ++i)
+	{
+		if ((uep->ue_array[uep->ue_size + i] = u_save_line(top + 1 + i)) == NULL)
+		{
+			while (i)
+				u_free_line(uep->ue_array[uep->ue_size + --i]);
+			return FALSE;
+		}
+	}
+	uep->ue_size += size;
+	uep->ue_bot = newbot;
+	return TRUE;
+}
+
 	void
 u_undo(count)
 	int count;
@@ -407,18 +472,18 @@ u_undoredo()
 		/* insert the lines in u_array between top and bot */
 		if (newsize)
 		{
-			for (lnum = top, i = 0; i < newsize; ++i, ++lnum)
-			{
-				/*
-				 * If the file is empty, there is an empty line 1 that we
-				 * should get rid of, by replacing it with the new line
-				 */
-				if (empty_buffer && lnum == 0)
-					ml_replace(1, uep->ue_array[i], TRUE);
-				else
-					ml_append(lnum, uep->ue_array[i], (colnr_t)0, FALSE);
+			i = 0;
+			/*
+			 * If the file is empty, there is an empty line 1 that we
+			 * should get rid of, by replacing it with the new line
+			 */
+			if (empty_buffer && top == 0)
+				ml_replace(1, uep->ue_array[i++], TRUE);
+			if (i < newsize)
+				(void)ml_append_lines(top + i, uep->ue_array + i, NULL,
+												(long)(newsize - i), FALSE);
+			for (i = 0; i < newsize; ++i)
 				u_free_line(uep->ue_array[i]);
-			}
 			u_free_line((char_u *)uep->ue_array);
 		}
 
@@ -443,6 +508,7 @@ u_undoredo()
 		u_newcount += newsize;
 		u_oldcount += oldsize;
 		uep->ue_size = oldsize;
+		uep->ue_space = oldsize;
 		uep->ue_array = newarray;
 		uep->ue_bot = top + newsize + 1;
 
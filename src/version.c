@@ -904,6 +904,43 @@ displayed twice. Now it is overwritten.
 Added "\?", "\/" and "\&" to ex address parsing, use previous search or
 substitute pattern.
 
+Compiled regexps are kept in a cache of 16 entries, repeating a search, an
+autocommand pattern, 'include' and 'define' are not compiled again.
+":regstat" shows how often the cache was used.
+
+Searching backward for a pattern that matches many times in a long line was
+slow, the line was matched again after each match to find the last one. Now
+the start of the last match is found in one pass.
+
+":s" builds the new text of a line in one buffer that grows, instead of
+copying the line for every match. Changed lines are put in the data blocks
+together, and lines changed one after another are saved for undo in one entry.
+":%s" on a big file and undoing it are much faster.
+
+With 'searchthreads' ":s" on a range of lines computes the new lines with
+several threads, they are put in the buffer in line order. Not when the "c"
+flag is used or the substitute string contains a line break.
+
+The lines marked by ":global" are kept in a sorted list of line numbers
+instead of in a bit of the index in the data blocks. Finding the next marked
+line doesn't scan the lines again, ":g/^/m0" on a big file is much faster.
+
+When a tags file has a "!_TAG_FILE_SORTED" line, the tag is found with a
+binary search instead of reading the whole file.
+Other tags files are read once, an index from the tag name to the position of
+the line is kept until the file changes.
+With USE_MMAP a tags file that is read completely is mapped into memory, only
+lines that may contain the tag are copied.
+
+The line where the search command of a tag matched is remembered, when it is
+the only match. Jumping to the tag again doesn't search the file when it
+didn't change.
+
+The quickfix error list is kept in an array instead of a linked list, ":cc
+123" doesn't need to go through the list. ":cf" only reads the errorfile up
+to the first error, the rest is read when needed or while waiting for a
+character.
+
 When there is not previous search pattern, would get two error messages. The
 last one, "invalid search string" is now omitted.
 
@@ -1296,6 +1333,67 @@ Adjusting marks for undo/redo was one line off.
 When 'wrap' option is off, make sure the whole character under the cursor is
 on the screen (for TAB and ctrl characters).
 
+The hash lists for memfile blocks and block number translations now grow with
+the number of blocks, instead of being fixed at 64 entries. Makes editing a
+very big file a lot faster.
+
+With USE_MMAP readfile() maps the file into memory and appends the lines
+directly from it, instead of copying the file with read() into a buffer first.
+The file is not changed, ml_append() now puts the NUL at the end of the line.
+
+Added 'lazyload' option: When editing a file bigger than this many
+Kbyte, only the first part is read before the screen is shown. The rest is
+read while waiting for a character. Typing a command finishes reading first.
+
+readfile() checks for NL and NUL a long at a time instead of one character at
+a time. About four times faster for finding the line breaks.
+
+Added ml_append_lines(): appends many lines with one lookup of the data
+block, filling it with as many lines as fit. Used by readfile(), "p" and undo.
+
+The memline remembers the last 16 data blocks used and the lines in them.
+Getting a line in one of these blocks no longer walks down the tree of pointer
+blocks.
+
+With USE_PTHREAD the swap file is written by a separate thread when syncing
+while waiting for a character. The changed blocks are copied, the thread
+writes them and does the fsync(). Avoids delays when typing with the swap
+file on a slow (network) file system.
+
+mf_sync() writes runs of consecutive swap file blocks with one writev() call.
+When blocks are read in sequence, 16 pages are read at once. ":mfstat" shows
+the number of system calls used for the swap files.
+
+The memfile keeps blocks that were used more than once in a protected part of
+the used list. Searching through a big file no longer pushes the pointer
+blocks and the displayed blocks out of memory. ":mfstat" shows the number of
+hits and misses, to find a good value for 'maxmem' and 'maxmemtot'.
+
+A pattern without a back reference ("\1") is matched with an NFA, which
+follows all alternatives at the same time. Takes time proportional to the
+length of the line, where backtracking could take ages, e.g. for
+"\(a\|aa\)*c". Patterns without choices still use backtracking.
+
+When a pattern starts with a literal string, the possible matches are found
+with strstr() instead of strchr() on the first character. A literal string
+further on in the pattern is also checked first, lines without it are skipped
+quickly. With 'ignorecase' strpbrk() is used to find the first character.
+
+Searching with "/", "?" and "n" looks for the literal string that every match
+contains in the text of the data blocks, without getting each line. Only the
+lines with that string are matched with the pattern. About twice as fast in a
+big file.
+
+New option 'searchthreads': number of threads used for "/", "?", "n" and
+":global" to find matching lines, when compiled with USE_PTHREAD. The
+regexp code keeps its work variables in a REGSTATE, regexec_state() can be
+used by several threads at the same time.
+
+regcomp() gets 'magic' and 'ignorecase' as arguments, the global variables
+reg_magic and reg_ic are gone. Ignoring case is remembered in the compiled
+regexp. An autocommand no longer changes 'magic' for the last search
+pattern.
+
 */
 
 char		   *Version = "VIM 3.9";